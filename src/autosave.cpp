@@ -0,0 +1,106 @@
+#include <coop/promise.hpp>
+#include <coop/runner.hpp>
+#include <coop/thread.hpp>
+#include <coop/timer.hpp>
+
+#include "autosave.hpp"
+#include "macros/logger.hpp"
+
+namespace asave {
+auto logger = Logger("asave");
+
+auto Autosaver::worker_main() -> coop::Async<void> {
+loop:
+    if(snapshot_requested) {
+        snapshot_requested = false;
+        // the snapshot contains every pending change, so the journal can be dropped after it is written
+        auto data = make_snapshot();
+        pending.clear();
+        journal_records   = 0;
+        snapshot_sequence = sequence;
+        dirty             = false;
+        // owned by the closure, the worker frame is gone if canceled while writing
+        const auto ret = co_await coop::run_blocking([this, data = std::move(data)]() {
+            const auto lock = std::lock_guard(io_lock);
+            return closed || (save::save_savedata(data) && save::clear_journal());
+        });
+        if(!ret) {
+            LOG_ERROR(logger, "failed to save snapshot");
+        }
+        goto loop;
+    }
+    if(!pending.empty()) {
+        journal_records += pending.size();
+        const auto ret = co_await coop::run_blocking([this, records = std::exchange(pending, {})]() {
+            const auto lock = std::lock_guard(io_lock);
+            return closed || save::append_journal(records);
+        });
+        if(!ret) {
+            LOG_ERROR(logger, "failed to append journal");
+        }
+        if(!ret || journal_records >= max_journal_records) {
+            snapshot_requested = true;
+        }
+        goto loop;
+    }
+    co_await event;
+    goto loop;
+}
+
+auto Autosaver::timer_main() -> coop::Async<void> {
+loop:
+    co_await coop::sleep(interval);
+    if(dirty || sequence != snapshot_sequence) {
+        request_snapshot();
+    }
+    goto loop;
+}
+
+auto Autosaver::record(save::JournalRecord record) -> void {
+    sequence += 1;
+    record.sequence = sequence;
+    pending.push_back(std::move(record));
+    event.notify();
+}
+
+auto Autosaver::mark_dirty() -> void {
+    dirty = true;
+}
+
+auto Autosaver::request_snapshot() -> void {
+    snapshot_requested = true;
+    event.notify();
+}
+
+auto Autosaver::get_sequence() const -> uint64_t {
+    return sequence;
+}
+
+auto Autosaver::set_sequence(const uint64_t sequence) -> void {
+    this->sequence    = sequence;
+    snapshot_sequence = sequence;
+}
+
+auto Autosaver::run(std::function<save::SaveData()> make_snapshot) -> coop::Async<void> {
+    this->make_snapshot = std::move(make_snapshot);
+    auto& runner        = *co_await coop::reveal_runner();
+    runner.push_task(worker_main(), &worker);
+    runner.push_task(timer_main(), &timer);
+}
+
+auto Autosaver::shutdown() -> void {
+    worker.cancel();
+    timer.cancel();
+}
+
+auto Autosaver::save_final(const save::SaveData& data) -> bool {
+    shutdown();
+    const auto lock = std::lock_guard(io_lock);
+    closed          = true;
+    return save::save_savedata(data) && save::clear_journal();
+}
+
+Autosaver::~Autosaver() {
+    shutdown();
+}
+} // namespace asave
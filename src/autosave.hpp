@@ -0,0 +1,53 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+#include <coop/generator.hpp>
+#include <coop/multi-event.hpp>
+#include <coop/task-handle.hpp>
+
+#include "save.hpp"
+
+namespace asave {
+// writes journal records and periodic snapshots in background
+// snapshots are taken on the ui thread, only disk io runs on the blocking thread
+class Autosaver {
+  private:
+    std::vector<save::JournalRecord> pending;
+    bool                             snapshot_requested = false;
+    size_t                           journal_records    = 0;     // since last snapshot
+    uint64_t                         sequence           = 0;     // of the last record
+    uint64_t                         snapshot_sequence  = 0;     // of the last record in the last snapshot
+    bool                             dirty              = false; // changed without a record since the last snapshot
+    bool                             closed             = false; // by save_final, later io is skipped
+    std::mutex                       io_lock;                      // disk io on the blocking thread keeps running after shutdown
+    std::function<save::SaveData()>  make_snapshot;
+    coop::TaskHandle                 worker;
+    coop::TaskHandle                 timer;
+    coop::MultiEvent                 event;
+
+    auto worker_main() -> coop::Async<void>;
+    auto timer_main() -> coop::Async<void>;
+
+  public:
+    std::chrono::seconds interval            = std::chrono::minutes(5);
+    size_t               max_journal_records = 1024; // take a snapshot after this many records
+
+    auto record(save::JournalRecord record) -> void;
+    // for changes which have no record, they are saved by the next periodic snapshot
+    auto mark_dirty() -> void;
+    auto request_snapshot() -> void;
+    // snapshots should carry this to tell which records they include
+    auto get_sequence() const -> uint64_t;
+    // continues numbering after the loaded save and journal
+    auto set_sequence(uint64_t sequence) -> void;
+    auto run(std::function<save::SaveData()> make_snapshot) -> coop::Async<void>;
+    auto shutdown() -> void;
+    // waits for the running disk io, then saves the snapshot and clears the journal
+    // nothing is written after this
+    auto save_final(const save::SaveData& data) -> bool;
+
+    ~Autosaver();
+};
+} // namespace asave
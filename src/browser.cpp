@@ -1,5 +1,8 @@
 #include <linux/input.h>
 
+#include <coop/parallel.hpp>
+#include <coop/thread.hpp>
+
 #include "browser.hpp"
 #include "constants.hpp"
 #include "gawl/fc.hpp"
@@ -28,9 +31,14 @@ auto HitomiBrowser::open_new_tab(const std::string_view title, const TabType typ
     auto tab       = std::shared_ptr<Tab>(new Tab());
     tab->type      = type;
     tab->title     = title;
+    tab->id        = next_tab_id;
+    next_tab_id += 1;
+    // tabs are not journaled until something is added to them
+    mark_dirty();
     auto callbacks = std::shared_ptr<GalleryTableCallbacks>();
     switch(type) {
     case TabType::Normal:
+    case TabType::Ranked:
         callbacks.reset(new GalleryTableCallbacks(tab, tman));
         break;
     case TabType::Search:
@@ -62,19 +70,50 @@ auto HitomiBrowser::sman_confirm(size_t search_id) -> bool {
     return false;
 }
 
-auto HitomiBrowser::sman_done(size_t search_id, std::vector<hitomi::GalleryID> result) -> void {
+auto HitomiBrowser::sman_progress(size_t search_id, std::vector<hitomi::GalleryID> result) -> void {
     unwrap_mut(window, window_callbacks->get_window());
 
     for(auto& tab : tabs.tabs) {
         if(tab->type != TabType::Search || tab->search_id != search_id) {
             continue;
         }
-        tab->search_id = 0;
+        if(tab->refreshing) {
+            // keep old works until the result is complete, so that the diff is meaningful
+            return;
+        }
+        // keep search_id, still searching
         tab->set_data(std::move(result));
         std::bit_cast<GalleryTable*>(tab->widget.get())->emit_visible_range_changed();
         window.refresh();
         return;
     }
+}
+
+auto HitomiBrowser::sman_done(size_t search_id, std::optional<std::vector<hitomi::GalleryID>> result) -> void {
+    unwrap_mut(window, window_callbacks->get_window());
+
+    for(auto& tab : tabs.tabs) {
+        if(tab->type != TabType::Search || tab->search_id != search_id) {
+            continue;
+        }
+        tab->search_id = 0;
+        if(!result) {
+            // keep the old works
+            if(std::exchange(tab->refreshing, false)) {
+                show_message("refresh failed, old works are kept");
+            }
+            window.refresh();
+            return;
+        }
+        const auto diff = tab->set_data(std::move(*result));
+        mark_dirty();
+        if(std::exchange(tab->refreshing, false)) {
+            show_message(std::format("{} new, {} gone since last refresh", diff.added, diff.removed));
+        }
+        std::bit_cast<GalleryTable*>(tab->widget.get())->emit_visible_range_changed();
+        window.refresh();
+        return;
+    }
     bail("unknown search result");
 }
 
@@ -102,9 +141,47 @@ auto HitomiBrowser::search_in_new_tab(std::string args) -> void {
     tab->start_search(sman, args);
 }
 
-auto HitomiBrowser::open_viewer(hitomi::Work work) -> void {
-    const auto callbacks = std::shared_ptr<imgview::Callbacks>(new imgview::Callbacks(std::move(work), fonts.normal));
-    runner.push_task(app.open_window({.manual_refresh = true}, callbacks));
+auto HitomiBrowser::search_title_in_new_tab(std::string query) -> void {
+    if(!index.is_loaded()) {
+        show_message("local index is still loading");
+        return;
+    }
+    auto result = index.search_title(query);
+    if(result.empty()) {
+        show_message("no title matched");
+        return;
+    }
+    // ranked tabs are not bookmark or import targets, which need descending order
+    const auto tab = open_new_tab(std::format("title: {}", query), TabType::Ranked);
+    tab->works.assign(result);
+    std::bit_cast<GalleryTable*>(tab->widget.get())->emit_visible_range_changed();
+    refresh_window();
+}
+
+auto HitomiBrowser::open_viewer(const hitomi::GalleryID id) -> void {
+    // thumbnail manager has the full work only if it was downloaded in this session
+    auto cached = std::shared_ptr<const hitomi::Work>();
+    if(const auto p = tman.get_caches().works.find(id); p != tman.get_caches().works.end()) {
+        cached = p->second.work;
+    }
+    runner.push_task([](HitomiBrowser& self, const hitomi::GalleryID id, const std::shared_ptr<const hitomi::Work> cached) -> coop::Async<void> {
+        auto work = cached ? *cached : hitomi::Work();
+        if(!cached) {
+            const auto fetched = std::make_shared<hitomi::Work>();
+            if(co_await coop::run_blocking([fetched, id]() -> bool { return fetched->init(id); })) {
+                work = *fetched;
+                self.tman.keep_work(id, fetched);
+            } else if(self.page_cache.get_pages(id) != 0) {
+                // pages read before are still readable without connection
+                self.show_message("failed to get gallery info, showing cached pages");
+            } else {
+                self.show_message("failed to get gallery info");
+                co_return;
+            }
+        }
+        const auto callbacks = std::shared_ptr<imgview::Callbacks>(new imgview::Callbacks(id, std::move(work), self.fonts.normal, self.pipeline, self.image_cache, self.page_cache));
+        self.runner.push_task(self.app.open_window({.manual_refresh = true}, callbacks));
+    }(*this, id, std::move(cached)));
 }
 
 auto HitomiBrowser::bookmark(std::string tab_title, const hitomi::GalleryID work) -> void {
@@ -119,18 +196,34 @@ auto HitomiBrowser::bookmark(std::string tab_title, const hitomi::GalleryID work
         target = open_new_tab(tab_title, TabType::Normal);
     }
     target->append_data(work);
+    journal({.op = save::JournalOp::Bookmark, .type = save::TabType::Normal, .title = tab_title, .new_title = {}, .work = work, .tab = target->id});
     last_bookmark = tab_title;
     show_message(std::format("saved to {}", tab_title));
 }
 
+auto HitomiBrowser::journal(save::JournalRecord record) -> void {
+    autosaver.record(std::move(record));
+}
+
+auto HitomiBrowser::is_current_tab(const Tab& tab) -> bool {
+    return tabs.index < tabs.tabs.size() && tabs.tabs[tabs.index].get() == &tab;
+}
+
+auto HitomiBrowser::mark_dirty() -> void {
+    autosaver.mark_dirty();
+}
+
+auto HitomiBrowser::toggle_local_search() -> void {
+    sman.local_first = !sman.local_first;
+    show_message(sman.local_first ? std::format("search local index first ({} galleries)", index.get_size()) : "search remote first");
+}
+
 auto HitomiBrowser::init() -> bool {
     if(false) {
         // imgview test
         unwrap_mut(fonts_, create_fonts());
         fonts     = std::move(fonts_);
-        auto work = hitomi::Work();
-        ensure(work.init(2495655));
-        open_viewer(work);
+        open_viewer(2495655);
         runner.run();
         exit(0);
     }
@@ -141,6 +234,14 @@ auto HitomiBrowser::init() -> bool {
     if(auto o = save::load_savedata()) {
         savedata = std::move(*o);
     }
+    // changes after the last save
+    const auto records = save::load_journal();
+    save::apply_journal(savedata, records);
+    autosaver.set_sequence(savedata.sequence);
+    if(!records.empty()) {
+        // fold the journal into the save file
+        autosaver.mark_dirty();
+    }
 
     tab_keybinds = {
         {KEY_DOWN, {false, false}, htk::table::Actions::Next},
@@ -161,10 +262,13 @@ auto HitomiBrowser::init() -> bool {
 
     // parse tabs
     for(auto& tab : savedata.tabs) {
-        const auto ptr = tabs.tabs.emplace_back(new Tab()).get();
-        ptr->title     = std::move(tab.title);
-        ptr->works     = std::move(tab.data);
-        ptr->index     = tab.index;
+        const auto ptr  = tabs.tabs.emplace_back(new Tab()).get();
+        ptr->title      = std::move(tab.title);
+        ptr->lazy_works = std::move(tab.lazy_data);
+        ptr->index      = tab.index;
+        ptr->id         = tab.id;
+        next_tab_id     = std::max(next_tab_id, tab.id + 1);
+        ptr->works.assign(tab.data);
         switch(tab.type) {
         case save::TabType::Normal:
             ptr->type = TabType::Normal;
@@ -172,6 +276,9 @@ auto HitomiBrowser::init() -> bool {
         case save::TabType::Search:
             ptr->type = TabType::Search;
             break;
+        case save::TabType::Ranked:
+            ptr->type = TabType::Ranked;
+            break;
         }
     }
     tabs.index = savedata.tabs_index;
@@ -186,6 +293,7 @@ auto HitomiBrowser::init() -> bool {
         auto callbacks = std::shared_ptr<GalleryTableCallbacks>();
         switch(ptr->type) {
         case TabType::Normal:
+        case TabType::Ranked:
             callbacks.reset(new GalleryTableCallbacks(ptr, tman));
             break;
         case TabType::Search:
@@ -201,6 +309,7 @@ auto HitomiBrowser::init() -> bool {
     }
     auto tab_list_callbacks  = std::shared_ptr<GalleryTableListCallbacks>(new GalleryTableListCallbacks());
     tab_list_callbacks->data = &tabs;
+    tab_list_callbacks->sman = &sman;
     tab_list.reset(new htk::tablist::TabList(fonts, std::move(tab_list_callbacks)));
     tab_list->keybinds = tab_list_keybinds;
 
@@ -221,6 +330,9 @@ auto HitomiBrowser::init() -> bool {
 
       public:
         auto close() -> void {
+            browser.autosaver.shutdown();
+            browser.page_cache.shutdown();
+            browser.index.shutdown();
             browser.sman.shutdown();
             browser.tman.shutdown();
             htk::Callbacks::close();
@@ -229,7 +341,11 @@ auto HitomiBrowser::init() -> bool {
         auto on_created(gawl::Window* window) -> coop::Async<bool> {
             co_await browser.tman.run(std::bit_cast<gawl::WaylandWindow*>(window));
             co_await browser.sman.run(std::bind(&HitomiBrowser::sman_confirm, &browser, std::placeholders::_1),
+                                      std::bind(&HitomiBrowser::sman_progress, &browser, std::placeholders::_1, std::placeholders::_2),
                                       std::bind(&HitomiBrowser::sman_done, &browser, std::placeholders::_1, std::placeholders::_2));
+            co_await browser.autosaver.run(std::bind(&HitomiBrowser::make_snapshot, &browser));
+            co_await browser.page_cache.run();
+            co_await browser.index.run();
 
             co_return true;
         }
@@ -246,28 +362,31 @@ auto HitomiBrowser::init() -> bool {
     return true;
 }
 
-auto HitomiBrowser::run() -> void {
-    runner.run();
-
-    // save
+auto HitomiBrowser::make_snapshot() -> save::SaveData {
     auto savedata                        = save::SaveData();
     savedata.layout_config.split_rate[1] = vsplit->value;
     savedata.layout_config.split_rate[0] = 1.0 - hsplit->value;
     savedata.layout_config.layout_type   = switcher->get_index();
     for(auto& tab : tabs.tabs) {
-        auto& tabdata = savedata.tabs.emplace_back();
-        tabdata.title = tab->title;
-        tabdata.data  = std::move(tab->works);
-        tabdata.index = tab->index;
-        switch(tab->type) {
-        case TabType::Normal:
-            tabdata.type = save::TabType::Normal;
-            break;
-        case TabType::Search:
-            tabdata.type = save::TabType::Search;
-            break;
-        }
+        // unvisited tabs are written from the old mapping without loading
+        auto& tabdata     = savedata.tabs.emplace_back();
+        tabdata.title     = tab->title;
+        tabdata.data      = tab->works.to_vector();
+        tabdata.lazy_data = tab->lazy_works;
+        tabdata.index     = tab->index;
+        tabdata.type      = to_save_tab_type(tab->type);
+        tabdata.id        = tab->id;
     }
     savedata.tabs_index = tabs.index;
-    ensure(save::save_savedata(savedata));
+    savedata.sequence   = autosaver.get_sequence();
+    return savedata;
+}
+
+auto HitomiBrowser::run() -> void {
+    runner.run();
+
+    // save
+    ensure(autosaver.save_final(make_snapshot()));
+    ensure(index.save());
+    page_cache.flush();
 }
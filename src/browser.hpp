@@ -1,7 +1,10 @@
+#include "autosave.hpp"
 #include "gawl/wayland/application.hpp"
 #include "global.hpp"
 #include "htk/modal.hpp"
 #include "htk/window.hpp"
+#include "image-cache.hpp"
+#include "page-cache.hpp"
 #include "widgets/gallery-info-display.hpp"
 #include "widgets/layout-switcher.hpp"
 #include "widgets/message.hpp"
@@ -10,9 +13,15 @@
 class HitomiBrowser : public Browser {
   private:
     Tabs                     tabs;
+    uint64_t                 next_tab_id = 1;
+    icache::ImageCache       image_cache; // these outlive viewers owned by app
+    pcache::PageCache        page_cache;
     gawl::WaylandApplication app;
-    tman::ThumbnailManager   tman;
-    sman::SearchManager      sman;
+    ipipe::Pipeline          pipeline;
+    lindex::Index            index;
+    tman::ThumbnailManager   tman = tman::ThumbnailManager(pipeline, index);
+    sman::SearchManager      sman = sman::SearchManager(index);
+    asave::Autosaver         autosaver;
     htk::Fonts               fonts;
     coop::Runner             runner;
 
@@ -31,15 +40,22 @@ class HitomiBrowser : public Browser {
 
     auto open_new_tab(std::string_view title, TabType type) -> Tab*;
     auto sman_confirm(size_t search_id) -> bool;
-    auto sman_done(size_t search_id, std::vector<hitomi::GalleryID> result) -> void;
+    auto sman_progress(size_t search_id, std::vector<hitomi::GalleryID> result) -> void;
+    auto sman_done(size_t search_id, std::optional<std::vector<hitomi::GalleryID>> result) -> void;
+    auto make_snapshot() -> save::SaveData;
 
   public:
     auto refresh_window() -> void override;
     auto show_message(std::string text) -> void override;
     auto begin_input(std::function<void(std::string)> handler, std::string prompt, std::string initial, size_t cursor) -> void override;
     auto search_in_new_tab(std::string args) -> void override;
-    auto open_viewer(hitomi::Work work) -> void override;
+    auto search_title_in_new_tab(std::string query) -> void override;
+    auto open_viewer(hitomi::GalleryID id) -> void override;
     auto bookmark(std::string tab_title, hitomi::GalleryID work) -> void override;
+    auto toggle_local_search() -> void override;
+    auto journal(save::JournalRecord record) -> void override;
+    auto is_current_tab(const Tab& tab) -> bool override;
+    auto mark_dirty() -> void override;
 
     auto init() -> bool;
     auto run() -> void;
@@ -0,0 +1,103 @@
+#pragma once
+#include <bit>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "macros/unwrap.hpp"
+
+// little helpers to build and parse binary blobs in memory
+namespace byteio {
+class Writer {
+  private:
+    std::vector<std::byte> data;
+
+  public:
+    auto write(const void* const ptr, const size_t size) -> void {
+        const auto bytes = std::bit_cast<const std::byte*>(ptr);
+        data.insert(data.end(), bytes, bytes + size);
+    }
+
+    template <class T>
+    auto write(const T& value) -> void {
+        write(&value, sizeof(T));
+    }
+
+    auto write_string(const std::string_view str) -> void {
+        write(uint64_t(str.size()));
+        write(str.data(), str.size());
+    }
+
+    auto write_strings(const std::span<const std::string> strs) -> void {
+        write(uint64_t(strs.size()));
+        for(const auto& str : strs) {
+            write_string(str);
+        }
+    }
+
+    auto get_size() const -> size_t {
+        return data.size();
+    }
+
+    auto release() -> std::vector<std::byte> {
+        return std::move(data);
+    }
+};
+
+class Reader {
+  private:
+    std::span<const std::byte> data;
+
+  public:
+    auto read(void* const ptr, const size_t size) -> bool {
+        ensure(data.size() >= size);
+        std::memcpy(ptr, data.data(), size);
+        data = data.subspan(size);
+        return true;
+    }
+
+    template <class T>
+    auto read() -> std::optional<T> {
+        auto value = T();
+        ensure(read(&value, sizeof(T)));
+        return value;
+    }
+
+    auto read_bytes(const size_t size) -> std::optional<std::span<const std::byte>> {
+        ensure(data.size() >= size);
+        const auto ret = data.subspan(0, size);
+        data           = data.subspan(size);
+        return ret;
+    }
+
+    auto read_string() -> std::optional<std::string> {
+        unwrap(size, read<uint64_t>());
+        ensure(data.size() >= size);
+        auto str = std::string(std::bit_cast<const char*>(data.data()), size);
+        data     = data.subspan(size);
+        return str;
+    }
+
+    auto read_strings() -> std::optional<std::vector<std::string>> {
+        unwrap(size, read<uint64_t>());
+        // every string has its size at least, do not allocate for corrupt counts
+        ensure(size <= remaining() / sizeof(uint64_t));
+        auto strs = std::vector<std::string>(size);
+        for(auto& str : strs) {
+            unwrap_mut(s, read_string());
+            str = std::move(s);
+        }
+        return strs;
+    }
+
+    // sizes read from untrusted data should be checked against this before allocating
+    auto remaining() const -> size_t {
+        return data.size();
+    }
+
+    Reader(const std::span<const std::byte> data)
+        : data(data) {}
+};
+} // namespace byteio
@@ -0,0 +1,102 @@
+#include <atomic>
+#include <filesystem>
+#include <format>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "disk-cache.hpp"
+#include "macros/logger.hpp"
+#include "macros/unwrap.hpp"
+#include "util/fd.hpp"
+
+namespace dcache {
+auto logger = Logger("dcache");
+
+namespace {
+// temporary files older than this are left by an interrupted run, newer ones may be being written
+const auto process_start = std::filesystem::file_time_type::clock::now();
+
+// unique per store, so that concurrent stores of the same key do not write to one file
+auto tmp_counter = std::atomic<uint64_t>(0);
+} // namespace
+
+auto get_cache_root() -> std::string {
+    return std::string(std::getenv("HOME")) + "/.cache/hitomi-browser";
+}
+
+auto DiskCache::get_path(const std::string_view key) const -> std::string {
+    return dir + "/" + std::string(key);
+}
+
+auto DiskCache::load(const std::string_view key) const -> std::optional<std::vector<std::byte>> {
+    const auto file = FileDescriptor(open(get_path(key).data(), O_RDONLY));
+    if(file.as_handle() == -1) {
+        return std::nullopt;
+    }
+    auto st = (struct stat){};
+    ensure(fstat(file.as_handle(), &st) == 0);
+
+    auto data = std::vector<std::byte>(st.st_size);
+    ensure(file.read(data.data(), data.size()));
+    return data;
+}
+
+auto DiskCache::store(const std::string_view key, const std::span<const std::byte> data) const -> bool {
+    const auto path     = get_path(key);
+    const auto tmp_path = std::format("{}.{}.{}.tmp", path, getpid(), tmp_counter.fetch_add(1));
+    const auto written  = [&]() -> bool {
+        const auto file = FileDescriptor(open(tmp_path.data(), O_WRONLY | O_CREAT | O_EXCL, 0644));
+        ensure(file.as_handle() != -1);
+        ensure(file.write(data.data(), data.size()));
+        return true;
+    }();
+    if(!written || rename(tmp_path.data(), path.data()) != 0) {
+        unlink(tmp_path.data());
+        return false;
+    }
+    return true;
+}
+
+auto DiskCache::erase(const std::string_view key) const -> void {
+    unlink(get_path(key).data());
+}
+
+auto DiskCache::touch(const std::string_view key) const -> void {
+    utimensat(AT_FDCWD, get_path(key).data(), nullptr, 0);
+}
+
+auto DiskCache::list() const -> std::vector<Entry> {
+    auto ret   = std::vector<Entry>();
+    auto error = std::error_code();
+    for(const auto& file : std::filesystem::directory_iterator(dir, error)) {
+        const auto name       = file.path().filename().string();
+        const auto last_write = file.last_write_time(error);
+        if(error) {
+            continue;
+        }
+        if(name.ends_with(".tmp")) {
+            if(last_write < process_start) {
+                erase(name);
+            }
+            continue;
+        }
+        const auto bytes = file.file_size(error);
+        if(error) {
+            continue;
+        }
+        ret.push_back({name, bytes, last_write});
+    }
+    return ret;
+}
+
+DiskCache::DiskCache(const std::string_view name)
+    : dir(get_cache_root() + "/" + std::string(name)) {
+    auto error = std::error_code();
+    std::filesystem::create_directories(dir, error);
+    if(error) {
+        LOG_ERROR(logger, "failed to create cache directory {}: {}", dir, error.message());
+    }
+}
+} // namespace dcache
@@ -0,0 +1,39 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace dcache {
+// returns ~/.cache/hitomi-browser
+auto get_cache_root() -> std::string;
+
+// directory of blobs under the cache root, one file per key
+// load and store are thread safe, concurrent stores of the same key leave one of them
+class DiskCache {
+  public:
+    struct Entry {
+        std::string                     key;
+        size_t                          bytes;
+        std::filesystem::file_time_type last_write;
+    };
+
+  private:
+    std::string dir;
+
+    auto get_path(std::string_view key) const -> std::string;
+
+  public:
+    auto load(std::string_view key) const -> std::optional<std::vector<std::byte>>;
+    // written to a temporary file and renamed, so readers never see partial blobs
+    auto store(std::string_view key, std::span<const std::byte> data) const -> bool;
+    auto erase(std::string_view key) const -> void;
+    // updates the last write time, for caches evicting least recently used blobs
+    auto touch(std::string_view key) const -> void;
+    // every stored blob, temporary files left by interrupted stores of earlier runs are removed
+    auto list() const -> std::vector<Entry>;
+
+    DiskCache(std::string_view name);
+};
+} // namespace dcache
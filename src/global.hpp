@@ -3,6 +3,9 @@
 #include <string>
 
 #include "hitomi/work.hpp"
+#include "save.hpp"
+
+struct Tab;
 
 class Browser {
   public:
@@ -13,8 +16,13 @@ class Browser {
     virtual auto show_message(std::string text) -> void                                                                                = 0;
     virtual auto begin_input(std::function<void(std::string)> handler, std::string prompt, std::string initial, size_t cursor) -> void = 0;
     virtual auto search_in_new_tab(std::string args) -> void                                                                           = 0;
-    virtual auto open_viewer(hitomi::Work work) -> void                                                                                = 0;
+    virtual auto search_title_in_new_tab(std::string query) -> void                                                                    = 0;
+    virtual auto open_viewer(hitomi::GalleryID id) -> void                                                                             = 0;
     virtual auto bookmark(std::string tab_title, hitomi::GalleryID work) -> void                                                       = 0;
+    virtual auto toggle_local_search() -> void                                                                                         = 0;
+    virtual auto journal(save::JournalRecord record) -> void                                                                           = 0;
+    virtual auto is_current_tab(const Tab& tab) -> bool                                                                                = 0;
+    virtual auto mark_dirty() -> void                                                                                                  = 0;
 };
 
 inline auto browser = (Browser*)(nullptr);
@@ -0,0 +1,180 @@
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "id-codec.hpp"
+#include "macros/unwrap.hpp"
+
+namespace idcodec {
+namespace {
+auto zigzag(const uint32_t value) -> uint32_t {
+    return (value << 1) ^ uint32_t(int32_t(value) >> 31);
+}
+
+auto unzigzag(const uint32_t value) -> uint32_t {
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+auto byte_length(const uint32_t value) -> size_t {
+    return value < (1u << 8) ? 1 : value < (1u << 16) ? 2 : value < (1u << 24) ? 3 : 4;
+}
+
+// total data bytes of 4 values for each control byte
+constexpr auto length_table = []() {
+    auto table = std::array<uint8_t, 256>();
+    for(auto control = 0uz; control < 256; control += 1) {
+        for(auto i = 0uz; i < 4; i += 1) {
+            table[control] += ((control >> (i * 2)) & 3) + 1;
+        }
+    }
+    return table;
+}();
+
+// pshufb masks which spread data bytes of 4 values into 4 uint32s
+[[maybe_unused]] constexpr auto shuffle_table = []() {
+    auto table = std::array<std::array<uint8_t, 16>, 256>();
+    for(auto control = 0uz; control < 256; control += 1) {
+        auto offset = uint8_t(0);
+        for(auto i = 0uz; i < 4; i += 1) {
+            const auto length = ((control >> (i * 2)) & 3) + 1;
+            for(auto b = 0uz; b < 4; b += 1) {
+                table[control][i * 4 + b] = b < length ? offset + b : 0x80;
+            }
+            offset += length;
+        }
+    }
+    return table;
+}();
+
+// decodes ids[begin, count), returns false on overrun
+auto decode_svb_scalar(const std::span<const std::byte> data, const size_t count, const size_t begin, size_t& pos, uint32_t& prev, uint32_t* const ids) -> bool {
+    for(auto i = begin; i < count; i += 1) {
+        const auto control = uint8_t(data[i / 4]);
+        const auto length  = size_t((control >> (i % 4 * 2)) & 3) + 1;
+        if(pos + length > data.size()) {
+            return false;
+        }
+        auto value = uint32_t(0);
+        for(auto b = 0uz; b < length; b += 1) {
+            value |= uint32_t(data[pos + b]) << (b * 8);
+        }
+        prev += unzigzag(value);
+        ids[i] = prev;
+        pos += length;
+    }
+    return true;
+}
+
+#if defined(__x86_64__)
+// decodes whole groups of 4 values as long as 16 bytes can be loaded, returns number of decoded values
+__attribute__((target("ssse3"))) auto decode_svb_ssse3(const std::span<const std::byte> data, const size_t count, size_t& pos, uint32_t& prev, uint32_t* const ids) -> size_t {
+    const auto one  = _mm_set1_epi32(1);
+    auto       base = _mm_set1_epi32(int(prev));
+    auto       i    = 0uz;
+    for(; i + 4 <= count && pos + 16 <= data.size(); i += 4) {
+        const auto control = uint8_t(data[i / 4]);
+        const auto input   = _mm_loadu_si128(std::bit_cast<const __m128i*>(data.data() + pos));
+        const auto mask    = _mm_loadu_si128(std::bit_cast<const __m128i*>(shuffle_table[control].data()));
+        auto       values  = _mm_shuffle_epi8(input, mask);
+        // unzigzag, then prefix sum of 4 lanes
+        values = _mm_xor_si128(_mm_srli_epi32(values, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(values, one)));
+        values = _mm_add_epi32(values, _mm_slli_si128(values, 4));
+        values = _mm_add_epi32(values, _mm_slli_si128(values, 8));
+        values = _mm_add_epi32(values, base);
+        _mm_storeu_si128(std::bit_cast<__m128i*>(ids + i), values);
+        base = _mm_shuffle_epi32(values, 0xff);
+        pos += length_table[control];
+    }
+    prev = uint32_t(_mm_cvtsi128_si32(base));
+    return i;
+}
+#endif
+} // namespace
+
+auto encode_varint(const std::span<const hitomi::GalleryID> ids) -> std::vector<std::byte> {
+    auto ret  = std::vector<std::byte>();
+    auto prev = uint64_t(0);
+    ret.reserve(ids.size() * 2);
+    for(const auto id : ids) {
+        auto delta = uint64_t(id) - prev;
+        prev       = uint64_t(id);
+        while(delta >= 0x80) {
+            ret.push_back(std::byte(delta | 0x80));
+            delta >>= 7;
+        }
+        ret.push_back(std::byte(delta));
+    }
+    return ret;
+}
+
+auto decode_varint(const std::span<const std::byte> data, const size_t count) -> std::optional<std::vector<hitomi::GalleryID>> {
+    // every id takes one byte at least
+    ensure(count <= data.size());
+    auto ret  = std::vector<hitomi::GalleryID>(count);
+    auto pos  = 0uz;
+    auto prev = uint64_t(0);
+    for(auto& id : ret) {
+        auto delta = uint64_t(0);
+        auto shift = 0;
+        while(true) {
+            ensure(pos < data.size() && shift < 64);
+            const auto byte = uint64_t(data[pos]);
+            pos += 1;
+            delta |= (byte & 0x7f) << shift;
+            shift += 7;
+            if(!(byte & 0x80)) {
+                break;
+            }
+        }
+        prev += delta;
+        id = hitomi::GalleryID(prev);
+    }
+    ensure(pos == data.size());
+    return ret;
+}
+
+auto encode_svb(const std::span<const hitomi::GalleryID> ids) -> std::vector<std::byte> {
+    const auto controls = (ids.size() + 3) / 4;
+    auto       ret      = std::vector<std::byte>(controls + ids.size() * 4);
+    auto       pos      = controls;
+    auto       prev     = uint32_t(0);
+    for(auto i = 0uz; i < ids.size(); i += 1) {
+        const auto value  = zigzag(uint32_t(ids[i]) - prev);
+        const auto length = byte_length(value);
+        prev              = uint32_t(ids[i]);
+        ret[i / 4] |= std::byte((length - 1) << (i % 4 * 2));
+        for(auto b = 0uz; b < length; b += 1) {
+            ret[pos + b] = std::byte(value >> (b * 8));
+        }
+        pos += length;
+    }
+    ret.resize(pos);
+    return ret;
+}
+
+auto decode_svb(const std::span<const std::byte> data, const size_t count) -> std::optional<std::vector<hitomi::GalleryID>> {
+    const auto controls = (count + 3) / 4;
+    ensure(controls <= data.size());
+
+    auto ids  = std::vector<uint32_t>(count);
+    auto pos  = controls;
+    auto prev = uint32_t(0);
+    auto done = 0uz;
+#if defined(__x86_64__)
+    if(__builtin_cpu_supports("ssse3")) {
+        done = decode_svb_ssse3(data, count, pos, prev, ids.data());
+    }
+#endif
+    ensure(decode_svb_scalar(data, count, done, pos, prev, ids.data()));
+    ensure(pos == data.size());
+
+    if constexpr(std::is_same_v<hitomi::GalleryID, uint32_t>) {
+        return ids;
+    } else {
+        return std::vector<hitomi::GalleryID>(ids.begin(), ids.end());
+    }
+}
+} // namespace idcodec
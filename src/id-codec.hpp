@@ -0,0 +1,20 @@
+#pragma once
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "hitomi/type.hpp"
+
+// compact encodings for gallery id arrays
+namespace idcodec {
+// ascending ids, stored as leb128 varint deltas from the previous one
+auto encode_varint(std::span<const hitomi::GalleryID> ids) -> std::vector<std::byte>;
+auto decode_varint(std::span<const std::byte> data, size_t count) -> std::optional<std::vector<hitomi::GalleryID>>;
+
+// ids in any order, ids must fit in 32 bits
+// zigzag deltas from the previous one in stream-vbyte layout:
+// 2-bit lengths of every 4 values packed in control bytes, followed by 1 to 4 bytes of each value
+// decoding takes one shuffle per 4 values on cpus with ssse3
+auto encode_svb(std::span<const hitomi::GalleryID> ids) -> std::vector<std::byte>;
+auto decode_svb(std::span<const std::byte> data, size_t count) -> std::optional<std::vector<hitomi::GalleryID>>;
+} // namespace idcodec
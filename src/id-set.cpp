@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <type_traits>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "id-set.hpp"
+
+namespace idset {
+namespace {
+// switch to galloping when one side is this times larger than the other
+constexpr auto gallop_ratio = 32uz;
+
+#if defined(__x86_64__)
+// pshufb masks which pack uint32 lanes selected by a 4 bit mask to the front
+constexpr auto pack_table = []() {
+    auto table = std::array<std::array<uint8_t, 16>, 16>();
+    for(auto mask = 0uz; mask < 16; mask += 1) {
+        auto lane = 0uz;
+        for(auto i = 0uz; i < 4; i += 1) {
+            if(!((mask >> i) & 1)) {
+                continue;
+            }
+            for(auto b = 0uz; b < 4; b += 1) {
+                table[mask][lane * 4 + b] = uint8_t(i * 4 + b);
+            }
+            lane += 1;
+        }
+        for(auto b = lane * 4; b < 16; b += 1) {
+            table[mask][b] = 0x80;
+        }
+    }
+    return table;
+}();
+
+// compares blocks of 4 ids from each side, against all 4 rotations of b
+// writes ids of a which are found in b if keep_found, else ids which are not
+// returns number of written ids, i and j are left where the scalar loop should continue
+// out must have room for a_size ids, every store is a whole block
+__attribute__((target("ssse3"))) auto merge_blocks_ssse3(const uint32_t* const a, const size_t a_size, const uint32_t* const b, const size_t b_size, const bool keep_found, size_t& i, size_t& j, uint32_t* const out) -> size_t {
+    auto k     = 0uz;
+    auto found = 0;
+    while(i + 4 <= a_size && j + 4 <= b_size) {
+        const auto va = _mm_loadu_si128(std::bit_cast<const __m128i*>(a + i));
+        const auto vb = _mm_loadu_si128(std::bit_cast<const __m128i*>(b + j));
+        const auto e0 = _mm_cmpeq_epi32(va, vb);
+        const auto e1 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x39));
+        const auto e2 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4e));
+        const auto e3 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x93));
+        found |= _mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(_mm_or_si128(e0, e1), _mm_or_si128(e2, e3))));
+        const auto a_last = a[i + 3];
+        const auto b_last = b[j + 3];
+        if(a_last <= b_last) {
+            // no later block of b can match this block of a
+            const auto keep = keep_found ? found : ~found & 0xf;
+            const auto mask = _mm_loadu_si128(std::bit_cast<const __m128i*>(pack_table[keep].data()));
+            _mm_storeu_si128(std::bit_cast<__m128i*>(out + k), _mm_shuffle_epi8(va, mask));
+            k += std::popcount(unsigned(keep));
+            found = 0;
+            i += 4;
+        }
+        if(a_last >= b_last) {
+            j += 4;
+        }
+    }
+    // matches of the unfinished block of a may be in blocks of b already passed
+    if(i < a_size) {
+        j = std::lower_bound(b, b + j, a[i]) - b;
+    }
+    return k;
+}
+
+// runs the simd kernel if available, returns number of written ids
+auto merge_blocks(const std::span<const hitomi::GalleryID> a, const std::span<const hitomi::GalleryID> b, const bool keep_found, size_t& i, size_t& j, hitomi::GalleryID* const out) -> size_t {
+    if constexpr(std::is_same_v<hitomi::GalleryID, uint32_t>) {
+        if(__builtin_cpu_supports("ssse3")) {
+            return merge_blocks_ssse3(std::bit_cast<const uint32_t*>(a.data()), a.size(), std::bit_cast<const uint32_t*>(b.data()), b.size(), keep_found, i, j, std::bit_cast<uint32_t*>(out));
+        }
+    }
+    return 0;
+}
+#else
+auto merge_blocks(const std::span<const hitomi::GalleryID> /*a*/, const std::span<const hitomi::GalleryID> /*b*/, const bool /*keep_found*/, size_t& /*i*/, size_t& /*j*/, hitomi::GalleryID* const /*out*/) -> size_t {
+    return 0;
+}
+#endif
+
+// merge loops below are branchless, the only branch is the loop condition
+// a is the smaller one
+auto intersect_merge(const std::span<const hitomi::GalleryID> a, const std::span<const hitomi::GalleryID> b) -> Set {
+    auto ret = Set(a.size());
+    auto i   = 0uz;
+    auto j   = 0uz;
+    auto k   = merge_blocks(a, b, true, i, j, ret.data());
+    while(i < a.size() && j < b.size()) {
+        const auto x = a[i];
+        const auto y = b[j];
+        ret[k]       = x;
+        k += x == y;
+        i += x <= y;
+        j += x >= y;
+    }
+    ret.resize(k);
+    return ret;
+}
+
+// a is the smaller one
+auto intersect_gallop(const std::span<const hitomi::GalleryID> a, const std::span<const hitomi::GalleryID> b) -> Set {
+    auto ret = Set();
+    auto pos = 0uz;
+    for(const auto x : a) {
+        // exponential search, then binary search in the last step
+        auto step = 1uz;
+        auto hi   = pos;
+        while(hi < b.size() && b[hi] < x) {
+            pos = hi + 1;
+            hi += step;
+            step *= 2;
+        }
+        pos = std::lower_bound(b.begin() + pos, b.begin() + std::min(hi, b.size()), x) - b.begin();
+        if(pos == b.size()) {
+            break;
+        }
+        if(b[pos] == x) {
+            ret.push_back(x);
+        }
+    }
+    return ret;
+}
+} // namespace
+
+auto normalize(Set& set) -> void {
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+}
+
+auto intersect(std::span<const hitomi::GalleryID> a, std::span<const hitomi::GalleryID> b) -> Set {
+    if(a.size() > b.size()) {
+        std::swap(a, b);
+    }
+    if(a.empty()) {
+        return {};
+    }
+    if(b.size() / a.size() >= gallop_ratio) {
+        return intersect_gallop(a, b);
+    }
+    return intersect_merge(a, b);
+}
+
+auto difference(const std::span<const hitomi::GalleryID> a, const std::span<const hitomi::GalleryID> b) -> Set {
+    auto ret = Set(a.size());
+    auto i   = 0uz;
+    auto j   = 0uz;
+    auto k   = merge_blocks(a, b, false, i, j, ret.data());
+    while(i < a.size() && j < b.size()) {
+        const auto x = a[i];
+        const auto y = b[j];
+        ret[k]       = x;
+        k += x < y;
+        i += x <= y;
+        j += x >= y;
+    }
+    std::copy(a.begin() + i, a.end(), ret.begin() + k);
+    ret.resize(k + (a.size() - i));
+    return ret;
+}
+
+auto unite(const std::span<const hitomi::GalleryID> a, const std::span<const hitomi::GalleryID> b) -> Set {
+    auto ret = Set(a.size() + b.size());
+    auto i   = 0uz;
+    auto j   = 0uz;
+    auto k   = 0uz;
+    while(i < a.size() && j < b.size()) {
+        const auto x = a[i];
+        const auto y = b[j];
+        ret[k]       = std::min(x, y);
+        k += 1;
+        i += x <= y;
+        j += x >= y;
+    }
+    k = std::copy(a.begin() + i, a.end(), ret.begin() + k) - ret.begin();
+    k = std::copy(b.begin() + j, b.end(), ret.begin() + k) - ret.begin();
+    ret.resize(k);
+    return ret;
+}
+} // namespace idset
@@ -0,0 +1,18 @@
+#pragma once
+#include <span>
+#include <vector>
+
+#include "hitomi/type.hpp"
+
+// set operations over sorted, unique arrays of gallery ids
+// all sets are in ascending order
+namespace idset {
+using Set = std::vector<hitomi::GalleryID>;
+
+// sort and deduplicate
+auto normalize(Set& set) -> void;
+auto intersect(std::span<const hitomi::GalleryID> a, std::span<const hitomi::GalleryID> b) -> Set;
+// a - b
+auto difference(std::span<const hitomi::GalleryID> a, std::span<const hitomi::GalleryID> b) -> Set;
+auto unite(std::span<const hitomi::GalleryID> a, std::span<const hitomi::GalleryID> b) -> Set;
+} // namespace idset
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+#include "image-cache.hpp"
+
+namespace icache {
+namespace {
+// entries farther than min_distance as a max heap of distances
+// built once per eviction, scanning for the farthest per victim was quadratic
+template <class Map, class Distance>
+auto collect_victims(Map& entries, const int min_distance, const Distance distance) -> std::vector<std::pair<int, typename Map::iterator>> {
+    auto ret = std::vector<std::pair<int, typename Map::iterator>>();
+    for(auto p = entries.begin(); p != entries.end(); p = std::next(p)) {
+        if(const auto d = distance(p->first); d > min_distance) {
+            ret.emplace_back(d, p);
+        }
+    }
+    std::make_heap(ret.begin(), ret.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    return ret;
+}
+
+template <class Victims>
+auto pop_victim(Victims& victims) -> typename Victims::value_type::second_type {
+    std::pop_heap(victims.begin(), victims.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    const auto ret = victims.back().second;
+    victims.pop_back();
+    return ret;
+}
+
+auto texture_distance(const std::pair<Client*, int>& key) -> int {
+    return std::abs(key.second - key.first->get_current_page());
+}
+} // namespace
+
+auto ImageCache::get_blob_distance(const BlobKey& key) const -> int {
+    auto ret = INT_MAX;
+    for(const auto client : clients) {
+        if(client->get_gallery() == key.first) {
+            ret = std::min(ret, std::abs(key.second - client->get_current_page()));
+        }
+    }
+    return ret;
+}
+
+auto ImageCache::add_client(Client& client) -> void {
+    clients.push_back(&client);
+}
+
+auto ImageCache::remove_client(const Client& client) -> void {
+    std::erase(clients, &client);
+    for(auto p = textures.begin(); p != textures.end();) {
+        if(p->first.first != &client) {
+            p = std::next(p);
+            continue;
+        }
+        texture_bytes -= p->second;
+        p = textures.erase(p);
+    }
+}
+
+auto ImageCache::add_texture(Client& client, const int page, const size_t bytes) -> bool {
+    // never count a page twice
+    remove_texture(client, page);
+
+    const auto key  = TextureKey{&client, page};
+    const auto dist = texture_distance(key);
+    if(texture_bytes + bytes > texture_limit) {
+        // only farther pages make room, otherwise read-ahead pages would evict each other forever
+        auto victims = collect_victims(textures, dist, texture_distance);
+        while(texture_bytes + bytes > texture_limit && !victims.empty()) {
+            const auto p                     = pop_victim(victims);
+            const auto [victim, victim_page] = p->first;
+            texture_bytes -= p->second;
+            textures.erase(p);
+            victim->evict_texture(victim_page);
+        }
+        // current page is always shown, then only current pages of viewers are left and counted over the limit
+        // later pages are refused until they are turned away from
+        if(texture_bytes + bytes > texture_limit && dist != 0) {
+            return false;
+        }
+    }
+    textures.emplace(key, bytes);
+    texture_bytes += bytes;
+    return true;
+}
+
+auto ImageCache::remove_texture(Client& client, const int page) -> void {
+    const auto p = textures.find(TextureKey{&client, page});
+    if(p == textures.end()) {
+        return;
+    }
+    texture_bytes -= p->second;
+    textures.erase(p);
+}
+
+auto ImageCache::add_blob(const hitomi::GalleryID gallery, const int page, std::vector<std::byte> data) -> void {
+    const auto key = BlobKey{gallery, page};
+    if(blobs.contains(key)) {
+        return;
+    }
+    if(blob_bytes + data.size() > blob_limit) {
+        // blobs of closed viewers are the farthest
+        const auto dist    = get_blob_distance(key);
+        auto       victims = collect_victims(blobs, dist, [this](const BlobKey& entry) { return get_blob_distance(entry); });
+        while(blob_bytes + data.size() > blob_limit && !victims.empty()) {
+            const auto p = pop_victim(victims);
+            blob_bytes -= p->second.size();
+            blobs.erase(p);
+        }
+        if(blob_bytes + data.size() > blob_limit) {
+            return;
+        }
+    }
+    blob_bytes += data.size();
+    blobs.emplace(key, std::move(data));
+}
+
+auto ImageCache::find_blob(const hitomi::GalleryID gallery, const int page) const -> const std::vector<std::byte>* {
+    const auto p = blobs.find(BlobKey{gallery, page});
+    return p != blobs.end() ? &p->second : nullptr;
+}
+
+auto ImageCache::get_texture_bytes() const -> size_t {
+    return texture_bytes;
+}
+} // namespace icache
@@ -0,0 +1,52 @@
+#pragma once
+#include <map>
+#include <vector>
+
+#include "hitomi/type.hpp"
+
+namespace icache {
+// a viewer window whose pages are cached
+class Client {
+  public:
+    virtual auto get_gallery() const -> hitomi::GalleryID = 0;
+    virtual auto get_current_page() const -> int         = 0;
+    // called when the texture of the page is evicted, the client must drop it
+    virtual auto evict_texture(int page) -> void = 0;
+
+    virtual ~Client() = default;
+};
+
+// process-wide budget of page textures and compressed blobs, shared by every viewer
+// farthest pages from the current page of their viewer are evicted first
+class ImageCache {
+  private:
+    using TextureKey = std::pair<Client*, int>;           // client, page
+    using BlobKey    = std::pair<hitomi::GalleryID, int>; // gallery, page
+
+    std::map<TextureKey, size_t>              textures; // -> bytes
+    std::map<BlobKey, std::vector<std::byte>> blobs;    // shared by viewers of the same gallery
+    std::vector<Client*>                      clients;
+    size_t                                    texture_bytes = 0;
+    size_t                                    blob_bytes    = 0;
+
+    // nearest distance from viewers of the gallery, or max int if none
+    auto get_blob_distance(const BlobKey& key) const -> int;
+
+  public:
+    size_t texture_limit = 1024uz * 1024 * 1024;
+    size_t blob_limit    = 256uz * 1024 * 1024;
+
+    auto add_client(Client& client) -> void;
+    // drops textures of the client, blobs are left for other viewers of the gallery
+    auto remove_client(const Client& client) -> void;
+    // returns false if the texture does not fit even after evicting farther pages
+    // in that case the caller should drop it and stop reading ahead that far
+    // an entry already added for the page is replaced
+    auto add_texture(Client& client, int page, size_t bytes) -> bool;
+    auto remove_texture(Client& client, int page) -> void;
+    // blobs are kept for a wider range, so that evicted pages can be decoded again without downloading
+    auto add_blob(hitomi::GalleryID gallery, int page, std::vector<std::byte> data) -> void;
+    auto find_blob(hitomi::GalleryID gallery, int page) const -> const std::vector<std::byte>*;
+    auto get_texture_bytes() const -> size_t;
+};
+} // namespace icache
@@ -0,0 +1,105 @@
+#include <thread>
+
+#include "image-pipeline.hpp"
+#include "resize.hpp"
+
+namespace ipipe {
+namespace {
+// decrements the counter even if the waiting task is canceled
+class WaitingCount {
+  private:
+    size_t*           count;
+    coop::MultiEvent* event;
+
+  public:
+    WaitingCount(size_t& count, coop::MultiEvent& event)
+        : count(&count),
+          event(&event) {
+        *this->count += 1;
+    }
+
+    WaitingCount(const WaitingCount&) = delete;
+
+    ~WaitingCount() {
+        *count -= 1;
+        event->notify(); // others may be waiting for this
+    }
+};
+} // namespace
+
+auto Stage::acquire(const Urgency urgent) -> coop::Async<void> {
+    // counted in urgent_waiting only while urgent
+    auto waiting = std::optional<WaitingCount>();
+loop:
+    const auto is_urgent = urgent && urgent();
+    if(is_urgent && !waiting) {
+        waiting.emplace(urgent_waiting, event);
+    } else if(!is_urgent && waiting) {
+        waiting.reset();
+    }
+    if(is_urgent ? running >= limit + 1 : running >= limit || urgent_waiting != 0) {
+        co_await event;
+        goto loop;
+    }
+    running += 1;
+}
+
+auto Stage::release() -> void {
+    running -= 1;
+    event.notify();
+}
+
+auto Stage::set_limit(const size_t new_limit) -> void {
+    limit = new_limit;
+    event.notify();
+}
+
+auto Stage::update_urgency() -> void {
+    event.notify();
+}
+
+Stage::Stage(const size_t limit)
+    : limit(limit) {}
+
+auto Pipeline::decode(std::vector<std::byte> blob, const size_t max_width, const size_t max_height, const Urgency urgent) -> coop::Async<std::optional<gawl::PixelBuffer>> {
+    co_return co_await run_in(
+        decode_stage,
+        [blob = std::move(blob), max_width, max_height]() -> std::optional<gawl::PixelBuffer> {
+            auto pixbuf = gawl::PixelBuffer::from_blob(blob);
+            if(!pixbuf) {
+                return std::nullopt;
+            }
+            return resize::fit(std::move(*pixbuf), max_width, max_height);
+        },
+        urgent);
+}
+
+auto Pipeline::upload(gawl::WaylandWindow* const window, gawl::PixelBuffer pixbuf, const Urgency urgent) -> coop::Async<gawl::Graphic> {
+    co_return co_await run_in(
+        upload_stage,
+        [window, pixbuf = std::move(pixbuf)]() {
+            auto context = window->fork_context();
+            auto graphic = gawl::Graphic(pixbuf);
+            context.wait();
+            return graphic;
+        },
+        urgent);
+}
+
+auto Pipeline::set_limits(const size_t fetch, const size_t decode, const size_t upload) -> void {
+    fetch_stage.set_limit(fetch);
+    decode_stage.set_limit(decode);
+    upload_stage.set_limit(upload);
+}
+
+auto Pipeline::update_urgency() -> void {
+    fetch_stage.update_urgency();
+    decode_stage.update_urgency();
+    upload_stage.update_urgency();
+}
+
+Pipeline::Pipeline()
+    : fetch_stage(16),
+      decode_stage(std::max(1u, std::thread::hardware_concurrency())),
+      upload_stage(2) {}
+} // namespace ipipe
@@ -0,0 +1,106 @@
+#pragma once
+#include <functional>
+#include <memory>
+
+#include <coop/generator.hpp>
+#include <coop/multi-event.hpp>
+#include <coop/parallel.hpp>
+#include <coop/promise.hpp>
+#include <coop/runner.hpp>
+#include <coop/thread.hpp>
+
+#include "gawl/graphic.hpp"
+#include "gawl/wayland/window.hpp"
+
+namespace ipipe {
+// asked again whenever a waiting task wakes, so that a task may become urgent while waiting
+// empty means never urgent
+using Urgency = std::function<bool()>;
+
+// limits the number of tasks in a stage at once
+// tasks over the limit wait in acquire()
+class Stage {
+  private:
+    size_t           running        = 0;
+    size_t           urgent_waiting = 0;
+    size_t           limit;
+    coop::MultiEvent event;
+
+  public:
+    // urgent tasks go before the others and may take one slot over the limit
+    auto acquire(Urgency urgent = {}) -> coop::Async<void>;
+    auto release() -> void;
+    auto set_limit(size_t new_limit) -> void;
+    // wakes waiting tasks to check their urgency again
+    auto update_urgency() -> void;
+
+    Stage(size_t limit);
+};
+
+// releases the slot when destroyed
+class Slot {
+  private:
+    Stage* stage;
+
+  public:
+    Slot(Stage& stage)
+        : stage(&stage) {}
+
+    Slot(const Slot&) = delete;
+
+    ~Slot() {
+        stage->release();
+    }
+};
+
+// network fetch, decode and texture upload shared by the browser and viewers
+// each stage has its own limit, so that slow downloads do not hold decoders or gl contexts
+class Pipeline {
+  private:
+    Stage fetch_stage;
+    Stage decode_stage;
+    Stage upload_stage;
+
+    // runs fn on the blocking thread in a slot of stage
+    // the blocking call keeps running if the caller is canceled, so a task of its own holds the slot until it returns
+    // fn should own everything it touches for the same reason
+    template <class F>
+    static auto run_in(Stage& stage, F fn, Urgency urgent) -> coop::Async<decltype(fn())> {
+        struct Result {
+            coop::MultiEvent              event;
+            std::optional<decltype(fn())> value;
+        };
+
+        auto& runner = *co_await coop::reveal_runner();
+        co_await stage.acquire(std::move(urgent));
+        const auto result = std::make_shared<Result>();
+        runner.push_task(
+            [](Stage& stage, F fn, const std::shared_ptr<Result> result) -> coop::Async<void> {
+                const auto slot = Slot(stage);
+                result->value.emplace(co_await coop::run_blocking(std::move(fn)));
+                result->event.notify();
+            }(stage, std::move(fn), result));
+        while(!result->value) {
+            co_await result->event;
+        }
+        co_return std::move(*result->value);
+    }
+
+  public:
+    // urgent is for the page on screen, which should not wait for read-ahead or thumbnails
+    template <class F>
+    auto fetch(F fn, Urgency urgent = {}) -> coop::Async<decltype(fn())> {
+        co_return co_await run_in(fetch_stage, std::move(fn), std::move(urgent));
+    }
+
+    // decoded image is shrunk to fit in max_width x max_height, 0 means unlimited
+    auto decode(std::vector<std::byte> blob, size_t max_width = 0, size_t max_height = 0, Urgency urgent = {}) -> coop::Async<std::optional<gawl::PixelBuffer>>;
+    auto upload(gawl::WaylandWindow* window, gawl::PixelBuffer pixbuf, Urgency urgent = {}) -> coop::Async<gawl::Graphic>;
+
+    auto set_limits(size_t fetch, size_t decode, size_t upload) -> void;
+    // call when the result of urgency callbacks may have changed, e.g. on page turn
+    auto update_urgency() -> void;
+
+    Pipeline();
+};
+} // namespace ipipe
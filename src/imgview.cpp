@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cmath>
+
 #include <linux/input.h>
 
 #include <coop/parallel.hpp>
@@ -10,18 +13,52 @@
 #include "imgview.hpp"
 
 namespace imgview {
-auto Callbacks::pickup_image_to_download() -> int {
-    const auto images_size = int(work.images.size());
+auto Callbacks::get_range() const -> std::pair<int, int> {
+    // doubled to absorb variance of download time
+    const auto ahead = std::clamp(int(std::ceil(turn_rate * load_seconds * 2)), min_ahead, max_ahead);
+    const auto first = direction > 0 ? page - behind_range : page - ahead;
+    const auto last  = direction > 0 ? page + ahead : page + behind_range;
+    return {std::max(0, first), std::min(pages - 1, last)};
+}
 
-    const auto index_begin = std::max(0, page - cache_range);
-    const auto index_end   = std::min(images_size - 1, page + cache_range);
+auto Callbacks::on_page_turn(const bool seek) -> void {
+    const auto now = std::chrono::steady_clock::now();
+    const auto dt  = std::chrono::duration<double>(now - last_turn).count();
+    last_turn      = now;
+    // seeks and idle periods say nothing about reading speed
+    if(seek || dt > 30.0 || dt <= 0.0) {
+        return;
+    }
+    turn_rate = turn_rate * 0.7 + (1.0 / dt) * 0.3;
+}
 
-    for(auto i = index_begin; i <= index_end; i += 1) {
-        if(cache[i]) {
-            continue;
+auto Callbacks::is_loading(const int page) const -> bool {
+    return std::ranges::any_of(loaders, [page](const Loader& loader) { return loader.downloading_page == page; });
+}
+
+auto Callbacks::pickup_image_to_download() -> int {
+    if(pages == 0) {
+        return -1;
+    }
+    const auto [first, last] = get_range();
+
+    // current page, then pages ahead, then pages behind, nearer first
+    const auto ahead_end  = direction > 0 ? std::min(last, page + reach) : std::max(first, page - reach);
+    const auto behind_end = direction > 0 ? std::max(first, page - reach) : std::min(last, page + reach);
+    for(auto i = page;; i += direction) {
+        if(!cache[i] && !is_loading(i)) {
+            cache[i] = Drawable();
+            return i;
+        }
+        if(i == ahead_end) {
+            break;
+        }
+    }
+    for(auto i = page - direction; i * direction >= behind_end * direction; i -= direction) {
+        if(!cache[i] && !is_loading(i)) {
+            cache[i] = Drawable();
+            return i;
         }
-        cache[i] = Drawable();
-        return i;
     }
 
     return -1;
@@ -29,6 +66,10 @@ auto Callbacks::pickup_image_to_download() -> int {
 
 auto Callbacks::loader_main(Loader& data) -> coop::Async<void> {
 loop:
+    if(resized) {
+        set_window_size((*resized)[0], (*resized)[1]);
+        resized.reset();
+    }
     const auto download_page = pickup_image_to_download();
     if(download_page == -1) {
         co_await loaders_event;
@@ -38,34 +79,73 @@ loop:
     do {
         data.downloading_page = download_page;
 
-        const auto& image = work.images[download_page];
         cache[download_page].emplace<Drawable>(Drawable::create<std::string>("loading..."));
 
-        data.cancel         = false;
-        const auto buffer_o = co_await coop::run_blocking([&image, &data]() { return image.download(true, &data.cancel); });
+        data.cancel      = false;
+        const auto start = std::chrono::steady_clock::now();
+        // the page may come on screen while waiting in the pipeline
+        const auto urgent = [this, download_page]() { return download_page == page; };
+        // evicted pages may still have the compressed image in memory, then pages read before on disk
+        const auto blob      = icache->find_blob(id, download_page);
+        const auto in_memory = blob != nullptr;
+        auto       buffer_o  = in_memory ? std::optional(*blob) : co_await pcache->load(id, download_page);
+        const auto on_disk   = !in_memory && buffer_o;
+        // work info is not available offline
+        const auto online = download_page < int(work.images.size());
+        if(!buffer_o && online) {
+            buffer_o = co_await pipeline->fetch([image = work.images[download_page], &data]() { return image.download(true, &data.cancel); }, urgent);
+        }
         if(!buffer_o) {
             if(!data.cancel) {
-                cache[download_page].emplace<Drawable>(Drawable::create<std::string>("failed to download image"));
+                cache[download_page].emplace<Drawable>(Drawable::create<std::string>(online ? "failed to download image" : "not cached"));
             }
             break;
         }
 
-        const auto pixbuf_o = co_await coop::run_blocking([&buffer_o]() { return gawl::PixelBuffer::from_blob(*buffer_o); });
+        // decoding at the window size saves upload bandwidth and vram for large scans
+        const auto size     = window_size;
+        auto       pixbuf_o = co_await pipeline->decode(*buffer_o, size[0], size[1], urgent);
         if(!pixbuf_o) {
             cache[download_page].emplace<Drawable>(Drawable::create<std::string>("failed to load image"));
             break;
         }
+        if(!on_disk && !in_memory) {
+            pcache->store(id, download_page, *buffer_o);
+        }
+        if(!in_memory) {
+            icache->add_blob(id, download_page, std::move(*buffer_o));
+        }
 
-        auto graphic = Drawable::create<Graphic>(co_await coop::run_blocking([this, &pixbuf_o]() {
-            auto context = std::bit_cast<gawl::WaylandWindow*>(window)->fork_context();
-            auto graph   = new gawl::Graphic(*pixbuf_o);
-            context.wait();
-            return graph;
-        }));
+        // if the window grew while decoding or uploading, decode again from the blob
+        const auto page_clipped = (size[0] != 0 && pixbuf_o->get_width() + 1 >= size[0]) || (size[1] != 0 && pixbuf_o->get_height() + 1 >= size[1]);
+        const auto outgrown     = [&]() { return page_clipped && (window_size[0] > size[0] || window_size[1] > size[1]); };
+        if(outgrown()) {
+            cache[download_page].reset();
+            break;
+        }
+
+        const auto bytes   = pixbuf_o->get_width() * pixbuf_o->get_height() * 4;
+        auto       graphic = co_await pipeline->upload(std::bit_cast<gawl::WaylandWindow*>(window), std::move(*pixbuf_o), urgent);
+        if(outgrown()) {
+            cache[download_page].reset();
+            break;
+        }
+
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        load_seconds       = load_seconds * 0.8 + elapsed * 0.2;
 
-        cache[download_page] = std::move(graphic);
+        // registered only when the texture exists, so that every evicted entry has one to drop
+        if(!icache->add_texture(*this, download_page, bytes)) {
+            // no room, do not read ahead this far until the page changes
+            reach = std::abs(download_page - page) - 1;
+            cache[download_page].reset();
+            break;
+        }
+        cache[download_page]   = Drawable::create<Graphic>(new gawl::Graphic(std::move(graphic)));
+        clipped[download_page] = page_clipped;
         break;
     } while(0);
+    data.downloading_page = -1;
 
     if(download_page == page) {
         window->refresh();
@@ -75,9 +155,7 @@ loop:
 }
 
 auto Callbacks::adjust_cache() -> void {
-    const auto images_size = int(work.images.size());
-    const auto index_begin = std::max(0, page - cache_range);
-    const auto index_end   = std::min(images_size - 1, page + cache_range);
+    const auto [index_begin, index_end] = get_range();
 
     for(auto& loader : loaders) {
         if(loader.downloading_page < index_begin || loader.downloading_page > index_end) {
@@ -85,12 +163,35 @@ auto Callbacks::adjust_cache() -> void {
         }
     }
 
-    for(auto i = 0; i < index_begin; i += 1) {
-        cache[i].reset();
+    // loaded pages are left to the image cache, drop the others to retry later
+    for(auto i = 0; i < pages; i += 1) {
+        if(i >= index_begin && i <= index_end) {
+            continue;
+        }
+        auto& entry = cache[i];
+        if(entry && !(entry->get_index() == Drawable::index_of<Graphic> && entry->as<Graphic>())) {
+            entry.reset();
+        }
     }
-    for(auto i = index_end + 1; i < images_size; i += 1) {
+}
+
+auto Callbacks::set_window_size(const size_t width, const size_t height) -> void {
+    const auto grown = width > window_size[0] || height > window_size[1];
+    window_size      = {width, height};
+    if(!grown) {
+        return;
+    }
+
+    // clipped pages are too small now, decode them again from the kept blobs
+    for(auto i = 0; i < pages; i += 1) {
+        // pages being loaded are decoded at the new size, or retried by the loader
+        if(!clipped[i] || !cache[i] || cache[i]->get_index() != Drawable::index_of<Graphic>) {
+            continue;
+        }
         cache[i].reset();
+        icache->remove_texture(*this, i);
     }
+    loaders_event.notify();
 }
 
 auto Callbacks::refresh() -> void {
@@ -99,6 +200,14 @@ auto Callbacks::refresh() -> void {
     const auto [screen_width, screen_height] = window->get_window_size();
     const auto screen_rect                   = gawl::Rectangle{{0, 0}, {1. * screen_width, 1. * screen_height}};
 
+    // textures must not be dropped while drawing, let a loader handle the new size
+    if(const auto size = std::array{size_t(screen_width), size_t(screen_height)}; size != window_size) {
+        resized = size;
+        loaders_event.notify();
+    } else {
+        resized.reset();
+    }
+
     auto& image = cache[page];
     if(image) {
         auto& drawable = *image;
@@ -118,7 +227,7 @@ auto Callbacks::refresh() -> void {
         font->draw_fit_rect(*window, screen_rect, {1, 1, 1, 1}, "loading...", {.size = font_size});
     }
 
-    const auto str  = std::format("[{}/{}]", page + 1, work.images.size());
+    const auto str  = std::format("[{}/{}]", page + 1, pages);
     const auto rect = gawl::Rectangle(font->get_rect(*window, str, font_size)).expand(2, 2);
     const auto box  = gawl::Rectangle{{0, screen_rect.height() - rect.height()}, {rect.width(), screen_rect.height()}};
     gawl::draw_rect(*window, box, {0, 0, 0, 0.5});
@@ -130,10 +239,14 @@ auto Callbacks::close() -> void {
         loader.cancel = true;
         loader.handle.cancel();
     }
+    icache->remove_client(*this);
     application->close_window(window);
 }
 
 auto Callbacks::on_created(gawl::Window* /*window*/) -> coop::Async<bool> {
+    const auto [width, height] = window->get_window_size();
+    window_size                = {size_t(width), size_t(height)};
+
     auto& runner = *co_await coop::reveal_runner();
     for(auto& loader : loaders) {
         runner.push_task(loader_main(loader), &loader.handle);
@@ -164,13 +277,21 @@ auto Callbacks::on_keycode(const uint32_t keycode, const gawl::ButtonState state
     case KEY_LEFT: {
         const auto next = keycode == KEY_SPACE || keycode == KEY_RIGHT;
 
-        page = std::clamp(page + (next ? 1 : -1) * (shift ? 10 : 1), 0, int(work.images.size()) - 1);
+        page = std::clamp(page + (next ? 1 : -1) * (shift ? 10 : 1), 0, pages - 1);
+        // shift jumps are seeks, keep the reading direction
+        if(!shift) {
+            direction = next ? 1 : -1;
+        }
+        on_page_turn(shift);
+        reach = max_ahead;
+        pipeline->update_urgency();
         loaders_event.notify();
         window->refresh();
         adjust_cache();
     } break;
     case KEY_C: {
         cache[page].reset();
+        icache->remove_texture(*this, page);
         loaders_event.notify();
         window->refresh();
     } break;
@@ -183,9 +304,33 @@ auto Callbacks::on_keycode(const uint32_t keycode, const gawl::ButtonState state
     co_return true;
 }
 
-Callbacks::Callbacks(hitomi::Work work, gawl::TextRender& font)
-    : font(&font) {
-    cache.resize(work.images.size());
+auto Callbacks::get_gallery() const -> hitomi::GalleryID {
+    return id;
+}
+
+auto Callbacks::get_current_page() const -> int {
+    return page;
+}
+
+auto Callbacks::evict_texture(const int page) -> void {
+    cache[page].reset();
+}
+
+Callbacks::Callbacks(const hitomi::GalleryID id, hitomi::Work work, gawl::TextRender& font, ipipe::Pipeline& pipeline, icache::ImageCache& icache, pcache::PageCache& pcache)
+    : id(id),
+      font(&font),
+      pipeline(&pipeline),
+      icache(&icache),
+      pcache(&pcache) {
+    // empty work means offline, show cached pages only
+    pages = work.images.empty() ? pcache.get_pages(id) : int(work.images.size());
+    cache.resize(pages);
+    clipped.resize(pages);
     this->work = std::move(work);
+    icache.add_client(*this);
+}
+
+Callbacks::~Callbacks() {
+    icache->remove_client(*this);
 }
 } // namespace imgview
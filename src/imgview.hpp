@@ -1,10 +1,15 @@
 #pragma once
+#include <chrono>
+
 #include <coop/multi-event.hpp>
 
 #include "gawl/graphic.hpp"
 #include "gawl/textrender.hpp"
 #include "gawl/window-callbacks.hpp"
 #include "hitomi/work.hpp"
+#include "image-cache.hpp"
+#include "image-pipeline.hpp"
+#include "page-cache.hpp"
 #include "util/variant.hpp"
 
 namespace imgview {
@@ -17,23 +22,44 @@ struct Loader {
     bool             cancel           = false;
 };
 
-class Callbacks : public gawl::WindowCallbacks {
+class Callbacks : public gawl::WindowCallbacks, public icache::Client {
   private:
-    constexpr static auto cache_range = 16;
-    constexpr static auto num_loaders = 8;
-
-    int                                  page  = 0;
-    bool                                 shift = false;
-    hitomi::Work                         work;
-    Graphic                              placeholder;
-    std::vector<std::optional<Drawable>> cache;
-    gawl::TextRender*                    font;
-    coop::MultiEvent                     loaders_event;
-    std::array<Loader, num_loaders>      loaders;
+    constexpr static auto num_loaders  = 8;
+    constexpr static auto behind_range = 6; // pages kept against the reading direction
+    constexpr static auto min_ahead    = 8; // pages read ahead in the reading direction
+    constexpr static auto max_ahead    = 64;
+
+    hitomi::GalleryID                     id;
+    int                                   pages        = 0; // work.images is empty if offline
+    int                                   page         = 0;
+    int                                   direction    = 1;         // 1 if reading forward, -1 if backward
+    int                                   reach        = max_ahead; // pages farther than this did not fit in image cache
+    bool                                  shift        = false;
+    double                                turn_rate    = 0.5; // pages per second, moving average
+    double                                load_seconds = 1.0; // per page, moving average
+    std::chrono::steady_clock::time_point last_turn;
+    hitomi::Work                          work;
+    Graphic                               placeholder;
+    std::vector<std::optional<Drawable>>  cache;
+    std::vector<bool>                     clipped; // shrunk to the window, needs re-decode if the window grows
+    std::array<size_t, 2>                 window_size = {0, 0}; // pages are decoded to fit in this, 0 means unlimited
+    std::optional<std::array<size_t, 2>>  resized;              // window size seen while drawing, applied by a loader
+    gawl::TextRender*                     font;
+    ipipe::Pipeline*                      pipeline;
+    icache::ImageCache*                   icache;
+    pcache::PageCache*                    pcache;
+    coop::MultiEvent                      loaders_event;
+    std::array<Loader, num_loaders>       loaders;
 
+    // pages to keep, extended to the reading direction as far as pages are read while one page loads
+    auto get_range() const -> std::pair<int, int>;
+    auto on_page_turn(bool seek) -> void;
+    // pages being loaded are not picked again even if their entry is reset meanwhile
+    auto is_loading(int page) const -> bool;
     auto pickup_image_to_download() -> int;
     auto loader_main(Loader& data) -> coop::Async<void>;
     auto adjust_cache() -> void;
+    auto set_window_size(size_t width, size_t height) -> void;
 
   public:
     int font_size = 16;
@@ -42,7 +68,11 @@ class Callbacks : public gawl::WindowCallbacks {
     auto close() -> void override;
     auto on_created(gawl::Window* window) -> coop::Async<bool> override;
     auto on_keycode(uint32_t keycode, gawl::ButtonState state) -> coop::Async<bool> override;
+    auto get_gallery() const -> hitomi::GalleryID override;
+    auto get_current_page() const -> int override;
+    auto evict_texture(int page) -> void override;
 
-    Callbacks(hitomi::Work work, gawl::TextRender& font);
+    Callbacks(hitomi::GalleryID id, hitomi::Work work, gawl::TextRender& font, ipipe::Pipeline& pipeline, icache::ImageCache& icache, pcache::PageCache& pcache);
+    ~Callbacks();
 };
 } // namespace imgview
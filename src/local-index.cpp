@@ -0,0 +1,349 @@
+#include <cmath>
+
+#include <coop/promise.hpp>
+#include <coop/runner.hpp>
+#include <coop/thread.hpp>
+#include <coop/timer.hpp>
+
+#include "local-index.hpp"
+#include "byte-io.hpp"
+#include "disk-cache.hpp"
+#include "id-codec.hpp"
+#include "macros/logger.hpp"
+#include "macros/unwrap.hpp"
+#include "thumbnail-manager.hpp"
+
+namespace lindex {
+namespace {
+auto logger = Logger("lindex");
+
+// bump this when the file layout changes
+constexpr auto index_version = uint32_t(2);
+constexpr auto index_key     = "postings";
+
+// artist, group, series, work type, tag, language
+constexpr auto indexed_categories = std::string_view("agswtl");
+
+// lowercase, punctuations to spaces, padded by spaces so that word boundaries make trigrams
+// non-ascii bytes are kept as is
+auto normalize_title(const std::string_view title) -> std::string {
+    auto ret = std::string(" ");
+    for(const auto c : title) {
+        const auto u = uint8_t(c);
+        if(u >= 0x80 || std::isalnum(u)) {
+            ret += char(std::tolower(u));
+        } else if(ret.back() != ' ') {
+            ret += ' ';
+        }
+    }
+    if(ret.back() != ' ') {
+        ret += ' ';
+    }
+    return ret;
+}
+
+// distinct trigrams, each packed into an integer
+auto make_trigrams(const std::string_view title) -> std::vector<uint32_t> {
+    const auto str = normalize_title(title);
+    auto       ret = std::vector<uint32_t>();
+    for(auto i = 0uz; i + 3 <= str.size(); i += 1) {
+        ret.push_back(uint32_t(uint8_t(str[i])) << 16 | uint32_t(uint8_t(str[i + 1])) << 8 | uint32_t(uint8_t(str[i + 2])));
+    }
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+auto write_set(byteio::Writer& writer, const idset::Set& set) -> void {
+    const auto encoded = idcodec::encode_varint(set);
+    writer.write(uint64_t(set.size()));
+    writer.write(uint64_t(encoded.size()));
+    writer.write(encoded.data(), encoded.size());
+}
+
+auto read_set(byteio::Reader& reader) -> std::optional<idset::Set> {
+    unwrap(count, reader.read<uint64_t>());
+    unwrap(size, reader.read<uint64_t>());
+    unwrap(bytes, reader.read_bytes(size));
+    return idcodec::decode_varint(bytes, count);
+}
+} // namespace
+
+auto TitleIndex::add(const hitomi::GalleryID id, const std::string_view title) -> void {
+    const auto grams   = make_trigrams(title);
+    const auto ordinal = uint32_t(entries.size());
+    entries.push_back(Entry{id, uint32_t(grams.size()), std::string(title)});
+    for(const auto gram : grams) {
+        postings[gram].push_back(ordinal);
+    }
+}
+
+auto TitleIndex::search(const std::string_view query, const double min_match, const size_t limit) const -> std::vector<hitomi::GalleryID> {
+    const auto grams = make_trigrams(query);
+    if(grams.empty()) {
+        return {};
+    }
+
+    // count matching trigrams of every title
+    // a flat counter is much faster than merging posting lists when some trigrams are common
+    const auto required   = std::max(uint32_t(1), uint32_t(std::ceil(grams.size() * min_match)));
+    auto       counts     = std::vector<uint32_t>(entries.size());
+    auto       candidates = std::vector<uint32_t>();
+    for(const auto gram : grams) {
+        if(const auto p = postings.find(gram); p != postings.end()) {
+            for(const auto ordinal : p->second) {
+                counts[ordinal] += 1;
+                if(counts[ordinal] == required) {
+                    candidates.push_back(ordinal);
+                }
+            }
+        }
+    }
+
+    struct Match {
+        uint32_t ordinal;
+        uint32_t common;
+        double   similarity;
+    };
+    auto matches = std::vector<Match>(candidates.size());
+    for(auto i = 0uz; i < candidates.size(); i += 1) {
+        const auto ordinal = candidates[i];
+        // dice coefficient, prefers titles close in length to the query
+        const auto similarity = 2.0 * counts[ordinal] / (grams.size() + entries[ordinal].grams);
+        matches[i]            = Match{ordinal, counts[ordinal], similarity};
+    }
+
+    // more query trigrams found first, then closer titles, then newer galleries
+    const auto better = [this](const Match& a, const Match& b) {
+        if(a.common != b.common) {
+            return a.common > b.common;
+        }
+        if(a.similarity != b.similarity) {
+            return a.similarity > b.similarity;
+        }
+        return entries[a.ordinal].id > entries[b.ordinal].id;
+    };
+    const auto count = std::min(limit, matches.size());
+    std::partial_sort(matches.begin(), matches.begin() + count, matches.end(), better);
+
+    auto ret = std::vector<hitomi::GalleryID>(count);
+    for(auto i = 0uz; i < count; i += 1) {
+        ret[i] = entries[matches[i].ordinal].id;
+    }
+    return ret;
+}
+
+auto TitleIndex::get_titles() const -> std::vector<std::pair<hitomi::GalleryID, std::string_view>> {
+    auto ret = std::vector<std::pair<hitomi::GalleryID, std::string_view>>();
+    ret.reserve(entries.size());
+    for(const auto& entry : entries) {
+        ret.emplace_back(entry.id, entry.title);
+    }
+    return ret;
+}
+
+auto Index::can_merge() const -> bool {
+    // loading moves the saved index in, saving reads the merged one from another thread
+    return loaded && !saving;
+}
+
+auto Index::merge_pending() -> void {
+    for(auto& [term, ids] : pending_postings) {
+        idset::normalize(ids);
+        auto& set = postings[term];
+        set       = set.empty() ? std::move(ids) : idset::unite(set, ids);
+    }
+    pending_postings.clear();
+
+    auto ids = idset::Set(pending_galleries.begin(), pending_galleries.end());
+    idset::normalize(ids);
+    galleries = idset::unite(galleries, ids);
+    pending_galleries.clear();
+
+    for(const auto& [id, title] : pending_titles) {
+        titles.add(id, title);
+    }
+    pending_titles.clear();
+}
+
+auto Index::add(const hitomi::GalleryID id, const tman::Metadata& meta) -> void {
+    if(std::binary_search(galleries.begin(), galleries.end(), id) || !pending_galleries.insert(id).second) {
+        return;
+    }
+    dirty               = true;
+    const auto add_term = [this, id](const char category, const std::string_view value) {
+        if(value.empty()) {
+            return;
+        }
+        pending_postings[category + std::string(value)].push_back(id);
+    };
+    for(const auto& artist : meta.artists) {
+        add_term('a', artist);
+    }
+    for(const auto& group : meta.groups) {
+        add_term('g', group);
+    }
+    for(const auto& series : meta.series) {
+        add_term('s', series);
+    }
+    for(const auto& tag : meta.tags) {
+        add_term('t', tag);
+    }
+    add_term('w', meta.type);
+    add_term('l', meta.language);
+    pending_titles.emplace_back(id, meta.display_name);
+    if(pending_galleries.size() >= merge_batch && can_merge()) {
+        merge_pending();
+    }
+}
+
+auto Index::covers(const std::string_view term) const -> bool {
+    return loaded && !term.empty() && indexed_categories.find(term[0]) != indexed_categories.npos;
+}
+
+auto Index::lookup(const std::string_view term) const -> std::optional<idset::Set> {
+    ensure(covers(term));
+    const auto key = std::string(term);
+    auto       ret = idset::Set();
+    if(const auto p = postings.find(key); p != postings.end()) {
+        ret = p->second;
+    }
+    // pending ones are fewer than a batch, merge them on the fly
+    if(const auto p = pending_postings.find(key); p != pending_postings.end()) {
+        auto pending = p->second;
+        idset::normalize(pending);
+        ret = idset::unite(ret, pending);
+    }
+    return ret;
+}
+
+auto Index::search_title(const std::string_view query) -> std::vector<hitomi::GalleryID> {
+    // trigram postings have no pending form, titles added while saving are found after that
+    if(can_merge()) {
+        merge_pending();
+    }
+    return titles.search(query);
+}
+
+auto Index::get_size() const -> size_t {
+    return galleries.size() + pending_galleries.size();
+}
+
+auto Index::is_loaded() const -> bool {
+    return loaded;
+}
+
+auto Index::read_contents() -> std::optional<Contents> {
+    unwrap(data, dcache::DiskCache("index").load(index_key));
+    auto reader = byteio::Reader(data);
+    unwrap(version, reader.read<uint32_t>());
+    ensure(version == index_version);
+
+    unwrap_mut(new_galleries, read_set(reader));
+    unwrap(terms, reader.read<uint64_t>());
+    auto new_postings = std::unordered_map<std::string, idset::Set>();
+    for(auto i = 0uz; i < terms; i += 1) {
+        unwrap_mut(term, reader.read_string());
+        unwrap_mut(set, read_set(reader));
+        new_postings.emplace(std::move(term), std::move(set));
+    }
+    // trigrams are cheap to rebuild, so only titles are stored
+    unwrap(num_titles, reader.read<uint64_t>());
+    auto new_titles = TitleIndex();
+    for(auto i = 0uz; i < num_titles; i += 1) {
+        unwrap(id, reader.read<hitomi::GalleryID>());
+        unwrap(title, reader.read_string());
+        new_titles.add(id, title);
+    }
+    return Contents{std::move(new_galleries), std::move(new_postings), std::move(new_titles)};
+}
+
+auto Index::load() -> coop::Async<void> {
+    auto contents = co_await coop::run_blocking([]() { return read_contents(); });
+    if(contents) {
+        galleries = std::move(contents->galleries);
+        postings  = std::move(contents->postings);
+        titles    = std::move(contents->titles);
+        // galleries seen while loading are still pending, postings are deduplicated by merge
+        const auto known = [this](const hitomi::GalleryID id) { return std::binary_search(galleries.begin(), galleries.end(), id); };
+        std::erase_if(pending_galleries, known);
+        std::erase_if(pending_titles, [&known](const auto& entry) { return known(entry.first); });
+    }
+    loaded = true;
+    if(pending_galleries.size() >= merge_batch) {
+        merge_pending();
+    }
+}
+
+auto Index::serialize() const -> std::vector<std::byte> {
+    auto writer = byteio::Writer();
+    writer.write(index_version);
+    write_set(writer, galleries);
+    writer.write(uint64_t(postings.size()));
+    for(const auto& [term, set] : postings) {
+        writer.write_string(term);
+        write_set(writer, set);
+    }
+    const auto title_entries = titles.get_titles();
+    writer.write(uint64_t(title_entries.size()));
+    for(const auto& [id, title] : title_entries) {
+        writer.write(id);
+        writer.write_string(title);
+    }
+    return writer.release();
+}
+
+auto Index::store(const std::span<const std::byte> data) const -> bool {
+    return dcache::DiskCache("index").store(index_key, data);
+}
+
+auto Index::worker_main() -> coop::Async<void> {
+    co_await load();
+loop:
+    co_await coop::sleep(save_interval);
+    if(!dirty) {
+        goto loop;
+    }
+    merge_pending();
+    dirty  = false;
+    saving = true;
+    // merged data is left untouched until this returns, new galleries stay pending
+    const auto ok = co_await coop::run_blocking([this]() {
+        const auto lock = std::lock_guard(store_lock);
+        return store(serialize());
+    });
+    saving = false;
+    if(!ok) {
+        LOG_ERROR(logger, "failed to save index");
+        dirty = true;
+    }
+    if(pending_galleries.size() >= merge_batch) {
+        merge_pending();
+    }
+    goto loop;
+}
+
+auto Index::save() -> bool {
+    if(!loaded) {
+        return true;
+    }
+    // waits for the periodic save canceled on shutdown
+    const auto lock = std::lock_guard(store_lock);
+    merge_pending();
+    dirty = false;
+    return store(serialize());
+}
+
+auto Index::run() -> coop::Async<void> {
+    auto& runner = *co_await coop::reveal_runner();
+    runner.push_task(worker_main(), &worker);
+}
+
+auto Index::shutdown() -> void {
+    worker.cancel();
+}
+
+Index::~Index() {
+    shutdown();
+}
+} // namespace lindex
@@ -0,0 +1,92 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <coop/generator.hpp>
+#include <coop/task-handle.hpp>
+
+#include "id-set.hpp"
+
+namespace tman {
+struct Metadata;
+}
+
+namespace lindex {
+// trigram index over display names for fuzzy title search
+class TitleIndex {
+  private:
+    struct Entry {
+        hitomi::GalleryID id;
+        uint32_t          grams; // number of distinct trigrams in title
+        std::string       title;
+    };
+
+    std::vector<Entry>                                  entries;  // ordinal -> entry
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings; // trigram -> ordinals, ascending
+
+  public:
+    auto add(hitomi::GalleryID id, std::string_view title) -> void;
+    // returns galleries containing at least min_match of trigrams of the query, best match first
+    auto search(std::string_view query, double min_match = 0.6, size_t limit = 1000) const -> std::vector<hitomi::GalleryID>;
+    auto get_titles() const -> std::vector<std::pair<hitomi::GalleryID, std::string_view>>;
+};
+
+// inverted index built from metadata of every gallery the thumbnail manager has seen
+// terms are in the same form as search terms, e.g. "ljapanese"
+class Index {
+  private:
+    // saved part of the index, read on a blocking thread and moved in
+    struct Contents {
+        idset::Set                                  galleries;
+        std::unordered_map<std::string, idset::Set> postings;
+        TitleIndex                                  titles;
+    };
+
+    idset::Set                                  galleries;
+    std::unordered_map<std::string, idset::Set> postings;
+    TitleIndex                                  titles;
+
+    // added since the last merge, unsorted
+    // appending and merging in batches avoids a vector insert per posting
+    std::unordered_set<hitomi::GalleryID>                  pending_galleries;
+    std::unordered_map<std::string, idset::Set>            pending_postings;
+    std::vector<std::pair<hitomi::GalleryID, std::string>> pending_titles;
+
+    bool               loaded = false; // queries are not served until the saved index is read
+    bool               saving = false; // merged data is being serialized in background, merges are held
+    bool               dirty  = false; // changed since the last save
+    coop::TaskHandle   worker;
+    mutable std::mutex store_lock; // held while serializing, periodic save may still be writing on exit
+
+    static auto read_contents() -> std::optional<Contents>;
+
+    auto can_merge() const -> bool;
+    auto merge_pending() -> void;
+    auto serialize() const -> std::vector<std::byte>;
+    auto store(std::span<const std::byte> data) const -> bool;
+    auto load() -> coop::Async<void>;
+    auto worker_main() -> coop::Async<void>;
+
+  public:
+    size_t               merge_batch   = 4096; // galleries
+    std::chrono::seconds save_interval = std::chrono::minutes(10);
+
+    auto add(hitomi::GalleryID id, const tman::Metadata& meta) -> void;
+    // true if the category of the term is indexed and the index is loaded
+    auto covers(std::string_view term) const -> bool;
+    auto lookup(std::string_view term) const -> std::optional<idset::Set>;
+    auto search_title(std::string_view query) -> std::vector<hitomi::GalleryID>;
+    auto get_size() const -> size_t;
+    auto is_loaded() const -> bool;
+    // does nothing until loaded, not to overwrite the saved index with a partial one
+    auto save() -> bool;
+    // loads, then saves periodically in background
+    auto run() -> coop::Async<void>;
+    auto shutdown() -> void;
+
+    ~Index();
+};
+} // namespace lindex
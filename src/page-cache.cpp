@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <limits>
+
+#include <coop/promise.hpp>
+#include <coop/runner.hpp>
+#include <coop/thread.hpp>
+
+#include "macros/logger.hpp"
+#include "macros/unwrap.hpp"
+#include "page-cache.hpp"
+
+namespace pcache {
+namespace {
+auto logger = Logger("pcache");
+
+auto to_disk_key(const hitomi::GalleryID id, const int page) -> std::string {
+    return std::format("{}-{}", id, page);
+}
+
+auto from_disk_key(const std::string_view str) -> std::optional<std::pair<hitomi::GalleryID, int>> {
+    const auto sep = str.find('-');
+    ensure(sep != str.npos);
+    const auto mid  = str.data() + sep;
+    const auto end  = str.data() + str.size();
+    auto       id   = hitomi::GalleryID();
+    auto       page = 0;
+    ensure(std::from_chars(str.data(), mid, id).ptr == mid);
+    ensure(std::from_chars(mid + 1, end, page).ptr == end);
+    return std::pair{id, page};
+}
+} // namespace
+
+auto PageCache::find_write(const Key& key) const -> const Write* {
+    // newest one wins
+    for(const auto writes : {&pending, &writing}) {
+        const auto p = std::find_if(writes->rbegin(), writes->rend(), [&key](const Write& w) { return w.key == key; });
+        if(p != writes->rend()) {
+            return &*p;
+        }
+    }
+    return nullptr;
+}
+
+auto PageCache::write_all(const std::span<const Write> writes) const -> size_t {
+    auto failed = 0uz;
+    for(const auto& write : writes) {
+        const auto key = to_disk_key(write.key.first, write.key.second);
+        if(write.data.empty()) {
+            disk.erase(key);
+        } else if(!disk.store(key, write.data)) {
+            failed += 1;
+        }
+    }
+    return failed;
+}
+
+auto PageCache::worker_main() -> coop::Async<void> {
+loop:
+    if(pending.empty()) {
+        co_await event;
+        goto loop;
+    }
+    writing          = std::exchange(pending, {});
+    const auto count = co_await coop::run_blocking([this]() {
+        const auto lock = std::lock_guard(write_lock);
+        return closed ? 0uz : write_all(writing);
+    });
+    if(count != 0) {
+        LOG_ERROR(logger, "failed to store {} pages", count);
+    }
+    for(const auto& write : writing) {
+        pending_bytes -= write.data.size();
+    }
+    writing.clear();
+    goto loop;
+}
+
+auto PageCache::evict() -> void {
+    // sizes of blobs not yet listed are unknown
+    if(!scanned || total_bytes <= limit) {
+        return;
+    }
+    auto order = std::vector<std::map<Key, Entry>::iterator>();
+    order.reserve(entries.size());
+    for(auto p = entries.begin(); p != entries.end(); p = std::next(p)) {
+        order.push_back(p);
+    }
+    std::ranges::sort(order, {}, [](const auto p) { return p->second.last_use; });
+
+    // erase down to 90% of the limit at once, so that this does not run on every store
+    const auto target = limit / 10 * 9;
+    for(const auto p : order) {
+        if(total_bytes <= target) {
+            break;
+        }
+        total_bytes -= p->second.bytes;
+        pending.push_back({p->first, {}});
+        entries.erase(p);
+    }
+    event.notify();
+}
+
+auto PageCache::load(const hitomi::GalleryID id, const int page) -> coop::Async<std::optional<std::vector<std::byte>>> {
+    const auto key = Key{id, page};
+    if(const auto write = find_write(key)) {
+        co_return write->data.empty() ? std::nullopt : std::optional(write->data);
+    }
+    if(scanned && !entries.contains(key)) {
+        co_return std::nullopt;
+    }
+
+    const auto disk_key = to_disk_key(id, page);
+    auto       data     = co_await coop::run_blocking([this, &disk_key]() {
+        auto ret = disk.load(disk_key);
+        if(ret) {
+            disk.touch(disk_key);
+        }
+        return ret;
+    });
+
+    // entries may have changed while loading
+    const auto p = entries.find(key);
+    if(!data) {
+        // failed store or erased outside, forget it
+        if(p != entries.end() && find_write(key) == nullptr) {
+            total_bytes -= p->second.bytes;
+            entries.erase(p);
+        }
+        co_return std::nullopt;
+    }
+    const auto now = std::filesystem::file_time_type::clock::now();
+    if(p != entries.end()) {
+        p->second.last_use = now;
+    } else {
+        entries.emplace(key, Entry{data->size(), now});
+        total_bytes += data->size();
+    }
+    co_return data;
+}
+
+auto PageCache::store(const hitomi::GalleryID id, const int page, std::vector<std::byte> data) -> void {
+    // if the disk is slower than the network, drop pages rather than buffer them without limit
+    if(data.empty() || pending_bytes + data.size() > pending_limit) {
+        return;
+    }
+    auto& entry = entries[{id, page}];
+    total_bytes -= entry.bytes;
+    entry = Entry{data.size(), std::filesystem::file_time_type::clock::now()};
+    total_bytes += entry.bytes;
+    pending_bytes += entry.bytes;
+    pending.push_back({{id, page}, std::move(data)});
+    evict();
+    event.notify();
+}
+
+auto PageCache::get_pages(const hitomi::GalleryID id) const -> int {
+    auto p = entries.upper_bound(Key{id, std::numeric_limits<int>::max()});
+    if(p == entries.begin()) {
+        return 0;
+    }
+    p = std::prev(p);
+    return p->first.first == id ? p->first.second + 1 : 0;
+}
+
+auto PageCache::run() -> coop::Async<void> {
+    auto& runner = *co_await coop::reveal_runner();
+    runner.push_task(worker_main(), &worker);
+
+    const auto files = co_await coop::run_blocking([this]() { return disk.list(); });
+    for(const auto& file : files) {
+        const auto key_o = from_disk_key(file.key);
+        if(!key_o) {
+            continue;
+        }
+        // pages stored during the scan are newer
+        if(entries.emplace(*key_o, Entry{file.bytes, file.last_write}).second) {
+            total_bytes += file.bytes;
+        }
+    }
+    scanned = true;
+    evict();
+}
+
+auto PageCache::shutdown() -> void {
+    worker.cancel();
+}
+
+auto PageCache::flush() -> void {
+    shutdown();
+    const auto lock = std::lock_guard(write_lock);
+    closed          = true;
+    // writing may be stored already if the worker was canceled after it, storing again is harmless
+    if(const auto count = write_all(writing) + write_all(pending); count != 0) {
+        LOG_ERROR(logger, "failed to store {} pages", count);
+    }
+    writing.clear();
+    pending.clear();
+    pending_bytes = 0;
+}
+
+PageCache::~PageCache() {
+    shutdown();
+}
+} // namespace pcache
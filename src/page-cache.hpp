@@ -0,0 +1,65 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <span>
+
+#include <coop/generator.hpp>
+#include <coop/multi-event.hpp>
+#include <coop/task-handle.hpp>
+
+#include "disk-cache.hpp"
+#include "hitomi/type.hpp"
+
+namespace pcache {
+// compressed page images of every gallery read in the viewer, kept on disk across sessions
+// least recently used pages are erased when the total size exceeds the limit
+// writes and erases run on the blocking thread in background, lookups never wait for them
+class PageCache {
+  private:
+    using Key = std::pair<hitomi::GalleryID, int>;
+
+    struct Entry {
+        size_t                          bytes = 0;
+        std::filesystem::file_time_type last_use;
+    };
+
+    // data is empty for erase
+    struct Write {
+        Key                    key;
+        std::vector<std::byte> data;
+    };
+
+    dcache::DiskCache    disk = dcache::DiskCache("pages");
+    std::map<Key, Entry> entries;
+    std::vector<Write>   pending;
+    std::vector<Write>   writing; // being written by the worker
+    size_t               total_bytes   = 0;
+    size_t               pending_bytes = 0;
+    bool                 scanned       = false; // entries has every blob on disk
+    bool                 closed        = false; // by flush, later writes by the canceled worker are skipped
+    std::mutex           write_lock;            // the worker may still be writing on the blocking thread after shutdown
+    coop::TaskHandle     worker;
+    coop::MultiEvent     event;
+
+    auto find_write(const Key& key) const -> const Write*;
+    // returns the number of failed stores
+    auto write_all(std::span<const Write> writes) const -> size_t;
+    auto worker_main() -> coop::Async<void>;
+    auto evict() -> void;
+
+  public:
+    size_t limit         = 2048uz * 1024 * 1024;
+    size_t pending_limit = 64uz * 1024 * 1024; // stores over this are dropped rather than piled up
+
+    auto load(hitomi::GalleryID id, int page) -> coop::Async<std::optional<std::vector<std::byte>>>;
+    auto store(hitomi::GalleryID id, int page, std::vector<std::byte> data) -> void;
+    // number of pages from the first page up to the last cached one, 0 if none is cached
+    auto get_pages(hitomi::GalleryID id) const -> int;
+    auto run() -> coop::Async<void>;
+    auto shutdown() -> void;
+    // writes pending pages on the calling thread, after the running write finishes
+    auto flush() -> void;
+
+    ~PageCache();
+};
+} // namespace pcache
@@ -0,0 +1,106 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "resize.hpp"
+
+namespace resize {
+namespace {
+// gcc vector extension, compiled to sse or neon without target specific code
+using Pixel  = float __attribute__((vector_size(16)));
+using Pixel8 = uint8_t __attribute__((vector_size(4)));
+
+auto load_pixel(const std::byte* const src) -> Pixel {
+    auto pixel = Pixel8();
+    std::memcpy(&pixel, src, sizeof(Pixel8));
+    return __builtin_convertvector(pixel, Pixel);
+}
+
+// source pixels covered by one destination pixel
+struct Span {
+    size_t             begin;
+    std::vector<float> weights;
+};
+
+auto calc_spans(const size_t src_size, const size_t dst_size) -> std::vector<Span> {
+    const auto scale = double(src_size) / dst_size;
+
+    auto spans = std::vector<Span>(dst_size);
+    for(auto i = 0uz; i < dst_size; i += 1) {
+        const auto a     = i * scale;
+        const auto b     = (i + 1) * scale;
+        const auto begin = size_t(a);
+        const auto end   = std::min(size_t(std::ceil(b)), src_size);
+
+        auto& span = spans[i];
+        span.begin = begin;
+        span.weights.resize(end - begin);
+        for(auto j = begin; j < end; j += 1) {
+            const auto covered      = std::min(b, j + 1.0) - std::max(a, double(j));
+            span.weights[j - begin] = float(covered / scale);
+        }
+    }
+    return spans;
+}
+} // namespace
+
+auto downscale(const std::byte* const src, const size_t width, const size_t height, const size_t dst_width, const size_t dst_height) -> std::vector<std::byte> {
+    const auto xspans = calc_spans(width, dst_width);
+    const auto yspans = calc_spans(height, dst_height);
+
+    // horizontal pass of one source row
+    // one pixel is one vector, so that all channels are processed by one instruction
+    const auto row_size  = dst_width * 4;
+    auto       row       = std::vector<float>(row_size);
+    auto       row_index = height; // source row in row
+    const auto scale_row = [&](const size_t y) {
+        const auto src_row = src + y * width * 4;
+        for(auto x = 0uz; x < dst_width; x += 1) {
+            const auto& span = xspans[x];
+            auto        acc  = Pixel{0, 0, 0, 0};
+            for(auto i = 0uz; i < span.weights.size(); i += 1) {
+                acc += load_pixel(src_row + (span.begin + i) * 4) * span.weights[i];
+            }
+            std::memcpy(row.data() + x * 4, &acc, sizeof(Pixel));
+        }
+        row_index = y;
+    };
+
+    // vertical pass, rows are accumulated as a whole so that the inner loop can be vectorized
+    // source rows are scaled on demand instead of all at once, to keep the working set in cache
+    auto acc = std::vector<float>(row_size);
+    auto dst = std::vector<std::byte>(dst_height * row_size);
+    for(auto y = 0uz; y < dst_height; y += 1) {
+        const auto& span = yspans[y];
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        for(auto i = 0uz; i < span.weights.size(); i += 1) {
+            // rows on the border of spans are shared with the previous one
+            if(row_index != span.begin + i) {
+                scale_row(span.begin + i);
+            }
+            const auto w = span.weights[i];
+            for(auto x = 0uz; x < row_size; x += 1) {
+                acc[x] += w * row[x];
+            }
+        }
+        const auto dst_row = dst.data() + y * row_size;
+        for(auto x = 0uz; x < row_size; x += 1) {
+            dst_row[x] = std::byte(std::min(acc[x] + 0.5f, 255.0f));
+        }
+    }
+    return dst;
+}
+
+auto fit(gawl::PixelBuffer pixbuf, const size_t max_width, const size_t max_height) -> gawl::PixelBuffer {
+    const auto width  = pixbuf.get_width();
+    const auto height = pixbuf.get_height();
+    const auto scale  = std::min(max_width == 0 ? 1.0 : double(max_width) / width, max_height == 0 ? 1.0 : double(max_height) / height);
+    if(scale >= 1.0) {
+        return pixbuf;
+    }
+    const auto dst_width  = std::max(1uz, size_t(width * scale));
+    const auto dst_height = std::max(1uz, size_t(height * scale));
+    const auto dst        = downscale(pixbuf.get_buffer(), width, height, dst_width, dst_height);
+    return gawl::PixelBuffer::from_raw(dst_width, dst_height, dst.data());
+}
+} // namespace resize
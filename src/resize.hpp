@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "gawl/graphic.hpp"
+
+namespace resize {
+// downscales rgba8 pixels with area averaging
+// dst_width <= width and dst_height <= height
+auto downscale(const std::byte* src, size_t width, size_t height, size_t dst_width, size_t dst_height) -> std::vector<std::byte>;
+
+// shrinks pixbuf to fit in max_width x max_height keeping aspect ratio
+// never upscales, 0 means unlimited
+auto fit(gawl::PixelBuffer pixbuf, size_t max_width, size_t max_height) -> gawl::PixelBuffer;
+} // namespace resize
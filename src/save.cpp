@@ -1,5 +1,14 @@
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#include "byte-io.hpp"
+#include "id-codec.hpp"
 #include "macros/unwrap.hpp"
 #include "save.hpp"
 #include "util/fd.hpp"
@@ -8,12 +17,44 @@ namespace {
 auto get_save_path() -> std::string {
     return std::string(std::getenv("HOME")) + "/.cache/hitomi-browser.dat";
 }
-} // namespace
 
-namespace save {
-auto load_savedata() -> std::optional<SaveData> {
-    const auto file = FileDescriptor(open(get_save_path().data(), O_RDONLY));
-    ensure(file.as_handle() != -1);
+auto get_journal_path() -> std::string {
+    return std::string(std::getenv("HOME")) + "/.cache/hitomi-browser.journal";
+}
+
+// version 1 had no header, it starts with LayoutConfig
+constexpr auto save_magic   = uint32_t(0x76736268); // "hbsv"
+constexpr auto save_version = uint32_t(5);
+
+struct Header {
+    uint32_t           magic;
+    uint32_t           version;
+    save::LayoutConfig layout_config;
+    uint64_t           tabs_size;
+    uint64_t           tabs_index;
+    uint64_t           sequence;
+};
+
+// version 2 and 3 have no sequence
+constexpr auto header_size_v3 = offsetof(Header, sequence);
+
+// followed by Header, offsets are from the beginning of the file
+struct TabEntry {
+    uint64_t      title_offset;
+    uint64_t      title_size;
+    save::TabType type;
+    uint64_t      index;
+    uint64_t      data_offset;
+    uint64_t      data_size;  // number of ids
+    uint64_t      data_bytes; // stream-vbyte encoded ids, missing in version 2 which has raw ids
+    uint64_t      id;         // missing before version 5
+};
+
+constexpr auto tab_entry_size_v2 = offsetof(TabEntry, data_bytes);
+constexpr auto tab_entry_size_v4 = offsetof(TabEntry, id);
+
+auto load_savedata_v1(const FileDescriptor& file) -> std::optional<save::SaveData> {
+    using namespace save;
 
     unwrap(layout_config, file.read<LayoutConfig>());
     unwrap(tabs_size, file.read<uint64_t>());
@@ -33,6 +74,7 @@ auto load_savedata() -> std::optional<SaveData> {
 
         unwrap(tab_type, file.read<TabType>());
         tabs[i].type = tab_type;
+        tabs[i].id   = i + 1;
 
         auto& data = tabs[i].data;
         unwrap(data_size, file.read<uint64_t>());
@@ -48,25 +90,373 @@ auto load_savedata() -> std::optional<SaveData> {
     return SaveData{layout_config, std::move(tabs), tabs_index};
 }
 
+// only the header and titles are read here, ids are left in the mapping
+auto load_savedata_mapped(std::shared_ptr<const save::Mapping> mapping) -> std::optional<save::SaveData> {
+    using namespace save;
+
+    const auto bytes = mapping->get_data();
+    ensure(bytes.size() >= header_size_v3);
+    auto version = uint32_t();
+    std::memcpy(&version, bytes.data() + offsetof(Header, version), sizeof(version));
+    ensure(version >= 2 && version <= save_version);
+    const auto header_size = version <= 3 ? header_size_v3 : sizeof(Header);
+    ensure(bytes.size() >= header_size);
+    auto header = Header(); // sequence is 0 in old versions
+    std::memcpy(static_cast<void*>(&header), bytes.data(), header_size);
+    const auto raw        = header.version == 2;
+    const auto entry_size = raw ? tab_entry_size_v2 : header.version <= 4 ? tab_entry_size_v4 : sizeof(TabEntry);
+    ensure(header.tabs_size <= (bytes.size() - header_size) / entry_size);
+
+    auto tabs = std::vector<TabData>(header.tabs_size);
+    for(auto i = 0uz; i < header.tabs_size; i += 1) {
+        auto entry = TabEntry();
+        std::memcpy(&entry, bytes.data() + header_size + i * entry_size, entry_size);
+        if(raw) {
+            ensure(entry.data_offset % alignof(hitomi::GalleryID) == 0);
+            ensure(entry.data_size <= bytes.size() / sizeof(hitomi::GalleryID));
+            entry.data_bytes = entry.data_size * sizeof(hitomi::GalleryID);
+        }
+        ensure(entry.title_offset <= bytes.size() && entry.title_size <= bytes.size() - entry.title_offset);
+        ensure(entry.data_offset <= bytes.size() && entry.data_bytes <= bytes.size() - entry.data_offset);
+
+        auto& tab = tabs[i];
+        tab.title = std::string(std::bit_cast<const char*>(bytes.data() + entry.title_offset), entry.title_size);
+        tab.type  = entry.type;
+        tab.index = entry.index;
+        // old saves get ids in order, which are the same every time the same file is loaded
+        tab.id = header.version <= 4 ? i + 1 : entry.id;
+        if(entry.data_size != 0) {
+            tab.lazy_data = LazyIDs{mapping, bytes.subspan(entry.data_offset, entry.data_bytes), entry.data_size, !raw};
+        }
+    }
+    return SaveData{header.layout_config, std::move(tabs), header.tabs_index, header.sequence};
+}
+
+// nullptr if the ids are broken, they are left in the mapping to be saved as they are
+auto materialize(save::TabData& tab) -> std::vector<hitomi::GalleryID>* {
+    if(tab.lazy_data.mapping) {
+        unwrap_mut(ids, save::decode_lazy_ids(tab.lazy_data));
+        tab.data      = std::move(ids);
+        tab.lazy_data = {};
+    }
+    return &tab.data;
+}
+
+auto find_tab(save::SaveData& save, const save::JournalRecord& record) -> std::vector<save::TabData>::iterator {
+    if(record.tab != 0) {
+        return std::find_if(save.tabs.begin(), save.tabs.end(), [&record](const save::TabData& tab) { return tab.id == record.tab; });
+    }
+    return std::find_if(save.tabs.begin(), save.tabs.end(), [&record](const save::TabData& tab) { return tab.type == record.type && tab.title == record.title; });
+}
+
+auto next_tab_id(const save::SaveData& save) -> uint64_t {
+    auto id = uint64_t(0);
+    for(const auto& tab : save.tabs) {
+        id = std::max(id, tab.id);
+    }
+    return id + 1;
+}
+
+// journal layout: magic, version, then records of payload size, crc-32 of payload and payload
+// journals without the magic have no crc, they are rewritten on load
+constexpr auto journal_magic   = uint32_t(0x6e6a6268); // "hbjn"
+constexpr auto journal_version = uint32_t(1);
+
+// crc-32 (ieee)
+constexpr auto crc_table = []() {
+    auto table = std::array<uint32_t, 256>();
+    for(auto i = 0uz; i < 256; i += 1) {
+        auto c = uint32_t(i);
+        for(auto k = 0; k < 8; k += 1) {
+            c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+    }
+    return table;
+}();
+
+auto crc32(const std::span<const std::byte> data) -> uint32_t {
+    auto crc = ~uint32_t(0);
+    for(const auto b : data) {
+        crc = crc_table[(crc ^ uint32_t(b)) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+auto encode_record(byteio::Writer& writer, const save::JournalRecord& record) -> void {
+    auto payload = byteio::Writer();
+    payload.write(record.op);
+    payload.write(record.type);
+    payload.write_string(record.title);
+    payload.write_string(record.new_title);
+    payload.write(record.work);
+    payload.write(record.sequence);
+    payload.write(record.tab);
+    // size and crc detect a record torn by a crash
+    const auto bytes = payload.release();
+    writer.write(uint32_t(bytes.size()));
+    writer.write(crc32(bytes));
+    writer.write(bytes.data(), bytes.size());
+}
+
+auto decode_record(byteio::Reader& reader, const bool legacy) -> std::optional<save::JournalRecord> {
+    unwrap(size, reader.read<uint32_t>());
+    const auto crc = legacy ? std::optional<uint32_t>(0) : reader.read<uint32_t>();
+    ensure(crc);
+    unwrap(bytes, reader.read_bytes(size));
+    ensure(legacy || crc32(bytes) == *crc);
+    auto payload = byteio::Reader(bytes);
+    auto record  = save::JournalRecord();
+    unwrap(op, payload.read<save::JournalOp>());
+    unwrap(type, payload.read<save::TabType>());
+    unwrap_mut(title, payload.read_string());
+    unwrap_mut(new_title, payload.read_string());
+    unwrap(work, payload.read<hitomi::GalleryID>());
+    ensure(op <= save::JournalOp::RenameTab && type <= save::TabType::Ranked);
+    // missing in old journals
+    const auto sequence = payload.read<uint64_t>();
+    const auto tab      = payload.read<uint64_t>();
+    return save::JournalRecord{op, type, std::move(title), std::move(new_title), work, sequence.value_or(0), tab.value_or(0)};
+}
+// replaces the journal with records in the current format
+auto rewrite_journal(const std::string& path, const std::span<const save::JournalRecord> records) -> bool {
+    auto writer = byteio::Writer();
+    writer.write(journal_magic);
+    writer.write(journal_version);
+    for(const auto& record : records) {
+        encode_record(writer, record);
+    }
+    const auto tmp_path = path + ".tmp";
+    const auto file     = FileDescriptor(open(tmp_path.data(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    ensure(file.as_handle() != -1);
+    const auto bytes = writer.release();
+    ensure(file.write(bytes.data(), bytes.size()));
+    ensure(fsync(file.as_handle()) == 0);
+    ensure(rename(tmp_path.data(), path.data()) == 0);
+    return true;
+}
+} // namespace
+
+namespace save {
+auto Mapping::get_data() const -> std::span<const std::byte> {
+    return {std::bit_cast<const std::byte*>(ptr), size};
+}
+
+Mapping::Mapping(void* const ptr, const size_t size)
+    : ptr(ptr),
+      size(size) {}
+
+Mapping::~Mapping() {
+    if(ptr != nullptr) {
+        munmap(ptr, size);
+    }
+}
+
+auto decode_lazy_ids(const LazyIDs& lazy) -> std::optional<std::vector<hitomi::GalleryID>> {
+    if(!lazy.encoded) {
+        const auto ids = std::bit_cast<const hitomi::GalleryID*>(lazy.data.data());
+        return std::vector<hitomi::GalleryID>(ids, ids + lazy.count);
+    }
+    unwrap_mut(ids, idcodec::decode_svb(lazy.data, lazy.count));
+    return std::move(ids);
+}
+
+auto load_savedata() -> std::optional<SaveData> {
+    const auto file = FileDescriptor(open(get_save_path().data(), O_RDONLY));
+    ensure(file.as_handle() != -1);
+
+    struct stat st;
+    ensure(fstat(file.as_handle(), &st) == 0);
+    const auto size  = size_t(st.st_size);
+    auto       magic = uint32_t(0);
+    if(size >= sizeof(magic)) {
+        ensure(pread(file.as_handle(), &magic, sizeof(magic), 0) == sizeof(magic));
+    }
+    if(magic != save_magic) {
+        return load_savedata_v1(file);
+    }
+
+    const auto ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.as_handle(), 0);
+    ensure(ptr != MAP_FAILED);
+    return load_savedata_mapped(std::shared_ptr<const Mapping>(new Mapping(ptr, size)));
+}
+
 auto save_savedata(const SaveData& save) -> bool {
-    const auto file = FileDescriptor(open(get_save_path().data(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    // the old file may still be mapped, so never overwrite it in place
+    const auto path     = get_save_path();
+    const auto tmp_path = path + ".tmp";
+    const auto file     = FileDescriptor(open(tmp_path.data(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
     ensure(file.as_handle() != -1);
 
-    ensure(file.write<LayoutConfig>(save.layout_config));
-    ensure(file.write(save.tabs.size()));
-    if(!save.tabs.empty()) {
-        ensure(file.write(save.tabs_index));
-        for(const auto& tab : save.tabs) {
-            ensure(file.write(tab.title.size()));
-            ensure(file.write(tab.title.data(), tab.title.size()));
-            ensure(file.write(tab.type));
-            ensure(file.write(tab.data.size()));
-            if(!tab.data.empty()) {
-                ensure(file.write(tab.index));
-                ensure(file.write(tab.data.data(), tab.data.size() * sizeof(hitomi::GalleryID)));
-            }
+    // unvisited tabs are copied as they are, the others are encoded here
+    auto encoded = std::vector<std::vector<std::byte>>(save.tabs.size());
+    auto blobs   = std::vector<std::span<const std::byte>>(save.tabs.size());
+    for(auto i = 0uz; i < save.tabs.size(); i += 1) {
+        const auto& tab = save.tabs[i];
+        if(tab.lazy_data.mapping && tab.lazy_data.encoded) {
+            blobs[i] = tab.lazy_data.data;
+        } else if(tab.lazy_data.mapping) {
+            unwrap(ids, decode_lazy_ids(tab.lazy_data));
+            encoded[i] = idcodec::encode_svb(ids);
+            blobs[i]   = encoded[i];
+        } else {
+            encoded[i] = idcodec::encode_svb(tab.data);
+            blobs[i]   = encoded[i];
         }
     }
+
+    // layout: header, tab entries, titles, ids
+    auto entries = std::vector<TabEntry>(save.tabs.size());
+    auto offset  = sizeof(Header) + sizeof(TabEntry) * entries.size();
+    for(auto i = 0uz; i < save.tabs.size(); i += 1) {
+        entries[i].title_offset = offset;
+        entries[i].title_size   = save.tabs[i].title.size();
+        entries[i].type         = save.tabs[i].type;
+        entries[i].index        = save.tabs[i].index;
+        entries[i].id           = save.tabs[i].id;
+        offset += entries[i].title_size;
+    }
+    for(auto i = 0uz; i < save.tabs.size(); i += 1) {
+        const auto& lazy       = save.tabs[i].lazy_data;
+        entries[i].data_offset = offset;
+        entries[i].data_size   = lazy.mapping ? lazy.count : save.tabs[i].data.size();
+        entries[i].data_bytes  = blobs[i].size();
+        offset += entries[i].data_bytes;
+    }
+
+    const auto header = Header{
+        .magic         = save_magic,
+        .version       = save_version,
+        .layout_config = save.layout_config,
+        .tabs_size     = save.tabs.size(),
+        .tabs_index    = save.tabs_index,
+        .sequence      = save.sequence,
+    };
+    ensure(file.write(header));
+    ensure(file.write(entries.data(), sizeof(TabEntry) * entries.size()));
+    for(const auto& tab : save.tabs) {
+        ensure(file.write(tab.title.data(), tab.title.size()));
+    }
+    for(const auto blob : blobs) {
+        ensure(file.write(blob.data(), blob.size()));
+    }
+    ensure(fsync(file.as_handle()) == 0);
+    ensure(rename(tmp_path.data(), path.data()) == 0);
     return true;
 }
+
+auto load_journal() -> std::vector<JournalRecord> {
+    const auto path = get_journal_path();
+    const auto file = FileDescriptor(open(path.data(), O_RDWR));
+    ensure(file.as_handle() != -1);
+    struct stat st;
+    ensure(fstat(file.as_handle(), &st) == 0);
+    auto bytes = std::vector<std::byte>(st.st_size);
+    ensure(file.read(bytes.data(), bytes.size()));
+
+    auto       reader  = byteio::Reader(bytes);
+    const auto magic   = reader.read<uint32_t>();
+    const auto version = reader.read<uint32_t>();
+    const auto legacy  = magic != journal_magic;
+    if(legacy) {
+        reader = byteio::Reader(bytes);
+    } else {
+        ensure(version == journal_version);
+    }
+
+    auto records = std::vector<JournalRecord>();
+    auto valid   = bytes.size() - reader.remaining();
+    while(auto record = decode_record(reader, legacy)) {
+        records.push_back(std::move(*record));
+        valid = bytes.size() - reader.remaining();
+    }
+    // records appended later must not sit behind a torn one or in another format
+    if(legacy && !bytes.empty()) {
+        rewrite_journal(path, records);
+    } else if(valid != bytes.size() && ftruncate(file.as_handle(), off_t(valid)) != 0) {
+        rewrite_journal(path, records);
+    }
+    return records;
+}
+
+auto append_journal(const std::span<const JournalRecord> records) -> bool {
+    const auto file = FileDescriptor(open(get_journal_path().data(), O_WRONLY | O_CREAT | O_APPEND, 0644));
+    ensure(file.as_handle() != -1);
+    struct stat st;
+    ensure(fstat(file.as_handle(), &st) == 0);
+
+    auto writer = byteio::Writer();
+    if(st.st_size == 0) {
+        writer.write(journal_magic);
+        writer.write(journal_version);
+    }
+    for(const auto& record : records) {
+        encode_record(writer, record);
+    }
+    const auto bytes = writer.release();
+    ensure(file.write(bytes.data(), bytes.size()));
+    ensure(fdatasync(file.as_handle()) == 0);
+    return true;
+}
+
+auto clear_journal() -> bool {
+    ensure(truncate(get_journal_path().data(), 0) == 0 || errno == ENOENT);
+    return true;
+}
+
+auto apply_journal(SaveData& save, const std::span<const JournalRecord> records) -> void {
+    for(const auto& record : records) {
+        // the snapshot was written but the journal was not cleared
+        if(record.sequence != 0 && record.sequence <= save.sequence) {
+            continue;
+        }
+        save.sequence = std::max(save.sequence, record.sequence);
+        switch(record.op) {
+        case JournalOp::Bookmark: {
+            auto tab = find_tab(save, record);
+            if(tab == save.tabs.end()) {
+                const auto id = record.tab != 0 ? record.tab : next_tab_id(save);
+                tab           = save.tabs.insert(save.tabs.end(), TabData{.title = record.title, .data = {}, .lazy_data = {}, .index = 0, .type = TabType::Normal, .id = id});
+            }
+            auto data = materialize(*tab);
+            if(data == nullptr) {
+                // the same as the ui, which drops broken ids when something is added
+                tab->lazy_data = {};
+                data           = &tab->data;
+            }
+            // tabs are sorted in descending order
+            const auto pos = std::lower_bound(data->begin(), data->end(), record.work, std::greater<hitomi::GalleryID>());
+            if(pos == data->end() || *pos != record.work) {
+                data->insert(pos, record.work);
+            }
+        } break;
+        case JournalOp::EraseWork: {
+            const auto tab = find_tab(save, record);
+            if(tab == save.tabs.end()) {
+                break;
+            }
+            const auto data = materialize(*tab);
+            if(data == nullptr) {
+                break;
+            }
+            std::erase(*data, record.work);
+            tab->index = std::min(tab->index, data->empty() ? 0 : data->size() - 1);
+        } break;
+        case JournalOp::EraseTab: {
+            const auto tab = find_tab(save, record);
+            if(tab == save.tabs.end()) {
+                break;
+            }
+            save.tabs.erase(tab);
+            save.tabs_index = std::min(save.tabs_index, save.tabs.empty() ? 0 : save.tabs.size() - 1);
+        } break;
+        case JournalOp::RenameTab: {
+            const auto tab = find_tab(save, record);
+            if(tab != save.tabs.end()) {
+                tab->title = record.new_title;
+            }
+        } break;
+        }
+    }
+}
 } // namespace save
@@ -1,5 +1,7 @@
 #pragma once
+#include <memory>
 #include <optional>
+#include <span>
 #include <vector>
 
 #include "hitomi/type.hpp"
@@ -13,21 +15,78 @@ struct LayoutConfig {
 enum class TabType : uint64_t {
     Normal = 0,
     Search = 1,
+    Ranked = 2,
 };
 
+// read-only mapping of a save file
+class Mapping {
+  private:
+    void*  ptr  = nullptr;
+    size_t size = 0;
+
+  public:
+    auto get_data() const -> std::span<const std::byte>;
+
+    Mapping(void* ptr, size_t size);
+    Mapping(const Mapping&) = delete;
+    ~Mapping();
+};
+
+// gallery ids left in a mapped save file until the tab is visited
+struct LazyIDs {
+    std::shared_ptr<const Mapping> mapping;
+    std::span<const std::byte>     data;
+    size_t                         count   = 0;
+    bool                           encoded = false; // stream-vbyte, else raw ids
+};
+
+// fails on corrupt data, the caller should keep lazy as it is
+auto decode_lazy_ids(const LazyIDs& lazy) -> std::optional<std::vector<hitomi::GalleryID>>;
+
 struct TabData {
     std::string                    title;
     std::vector<hitomi::GalleryID> data;
+    LazyIDs                        lazy_data; // used instead of data if mapping is set
     uint64_t                       index;
     TabType                        type;
+    uint64_t                       id = 0; // unique in the save, kept across renames
 };
 
 struct SaveData {
     LayoutConfig         layout_config;
     std::vector<TabData> tabs;
     uint64_t             tabs_index = 0;
+    uint64_t             sequence   = 0; // of the last journal record included
+};
+
+// changes made since the last save, replayed on load
+// tabs are identified by id, old journals without ids fall back to type and title
+enum class JournalOp : uint8_t {
+    Bookmark  = 0, // add work to the normal tab, create it named title if missing
+    EraseWork = 1,
+    EraseTab  = 2,
+    RenameTab = 3, // title -> new_title
+};
+
+struct JournalRecord {
+    JournalOp         op;
+    TabType           type;
+    std::string       title;
+    std::string       new_title;
+    hitomi::GalleryID work     = 0;
+    uint64_t          sequence = 0; // assigned by asave::Autosaver in increasing order, 0 in old journals
+    uint64_t          tab      = 0; // TabData::id, 0 in old journals
 };
 
 auto load_savedata() -> std::optional<SaveData>;
+// writes to a temporary file and renames it, the old file is intact on failure
+// not thread safe, asave::Autosaver serializes calls
 auto save_savedata(const SaveData& save) -> bool;
+
+// broken records at the end, left by a crash, are cut off so that later appends are readable
+auto load_journal() -> std::vector<JournalRecord>;
+auto append_journal(std::span<const JournalRecord> records) -> bool;
+auto clear_journal() -> bool;
+// records up to save.sequence are already in the save and skipped
+auto apply_journal(SaveData& save, std::span<const JournalRecord> records) -> void;
 } // namespace save
@@ -4,46 +4,392 @@
 #include <coop/task-handle.hpp>
 #include <coop/thread.hpp>
 
+#include "global.hpp"
 #include "hitomi/search.hpp"
+#include "macros/unwrap.hpp"
 #include "search-manager.hpp"
 
 namespace sman {
-auto SearchManager::worker_main(const ConfirmCallback confirm, const DoneCallback done) -> coop::Async<void> {
+namespace {
+auto get_bytes(const CachedResult& entry) -> size_t {
+    return entry.result.size() * sizeof(hitomi::GalleryID);
+}
+
+// drops expired entries, then the oldest ones until the new result fits in max_bytes
+auto cache_result(std::unordered_map<std::string, CachedResult>& cache, const std::string& key, CachedResult entry, const std::chrono::seconds ttl, const size_t max_bytes) -> void {
+    cache.erase(key);
+    std::erase_if(cache, [now = entry.time, ttl](const auto& p) { return now - p.second.time >= ttl; });
+    const auto new_bytes = get_bytes(entry);
+    if(new_bytes > max_bytes) {
+        return;
+    }
+    auto bytes = 0uz;
+    for(const auto& [_, e] : cache) {
+        bytes += get_bytes(e);
+    }
+    while(bytes + new_bytes > max_bytes) {
+        const auto oldest = std::min_element(cache.begin(), cache.end(), [](const auto& a, const auto& b) { return a.second.time < b.second.time; });
+        bytes -= get_bytes(oldest->second);
+        cache.erase(oldest);
+    }
+    cache.emplace(key, std::move(entry));
+}
+} // namespace
+
+auto split_args(const std::string_view args) -> std::optional<std::vector<std::string>> {
+    auto terms    = std::vector<std::string>();
+    auto term     = std::string();
+    auto quoted   = false;
+    auto depth    = 0;
+    auto has_term = false;
+    for(const auto c : args) {
+        if(c == '"') {
+            quoted   = !quoted;
+            has_term = true;
+        } else if(c == ' ' && !quoted && depth == 0) {
+            if(has_term) {
+                terms.push_back(std::exchange(term, {}));
+                has_term = false;
+            }
+        } else {
+            if(!quoted) {
+                depth += c == '(' ? 1 : c == ')' ? -1 : 0;
+                ensure(depth >= 0);
+            }
+            term += c;
+            has_term = true;
+        }
+    }
+    ensure(depth == 0);
+    if(has_term) {
+        terms.push_back(std::move(term));
+    }
+    return terms;
+}
+
+auto quote_term(const std::string_view term) -> std::string {
+    if(term.find(' ') != term.npos) {
+        return '"' + std::string(term) + '"';
+    } else {
+        return std::string(term);
+    }
+}
+
+auto parse_args(const std::string_view args) -> std::optional<std::vector<Clause>> {
+    unwrap(terms, split_args(args));
+    auto clauses = std::vector<Clause>();
+    for(auto term : terms) {
+        auto& clause   = clauses.emplace_back();
+        clause.exclude = term.starts_with('-');
+        auto body      = std::string_view(term).substr(clause.exclude ? 1 : 0);
+        if(body.starts_with('(')) {
+            ensure(body.ends_with(')'));
+            body.remove_prefix(1);
+            body.remove_suffix(1);
+            for(auto begin = 0uz; begin <= body.size();) {
+                const auto end = std::min(body.find('|', begin), body.size());
+                clause.alternatives.emplace_back(body.substr(begin, end - begin));
+                begin = end + 1;
+            }
+        } else {
+            clause.alternatives.emplace_back(body);
+        }
+        for(const auto& alt : clause.alternatives) {
+            ensure(!alt.empty());
+        }
+        std::sort(clause.alternatives.begin(), clause.alternatives.end());
+        clause.alternatives.erase(std::unique(clause.alternatives.begin(), clause.alternatives.end()), clause.alternatives.end());
+    }
+    std::sort(clauses.begin(), clauses.end());
+    clauses.erase(std::unique(clauses.begin(), clauses.end()), clauses.end());
+    return clauses;
+}
+
+auto normalize_args(const std::string_view args) -> std::string {
+    const auto clauses_o = parse_args(args);
+    if(!clauses_o) {
+        return std::string(args);
+    }
+
+    auto ret = std::string();
+    for(const auto& clause : *clauses_o) {
+        auto str = std::string(clause.exclude ? "-" : "");
+        if(clause.alternatives.size() == 1) {
+            str += clause.alternatives[0];
+        } else {
+            str += "(";
+            for(const auto& alt : clause.alternatives) {
+                str += alt + "|";
+            }
+            str.back() = ')';
+        }
+        if(!ret.empty()) {
+            ret += ' ';
+        }
+        ret += quote_term(str);
+    }
+    return ret;
+}
+
+auto SearchManager::is_cached(const Clause& clause, const std::chrono::steady_clock::time_point now) const -> bool {
+    for(const auto& alt : clause.alternatives) {
+        const auto p = term_results.find(alt);
+        if(p == term_results.end() || now - p->second.time >= result_ttl) {
+            return false;
+        }
+    }
+    return true;
+}
+
+auto SearchManager::is_indexed(const std::vector<Clause>& clauses) const -> bool {
+    for(const auto& clause : clauses) {
+        for(const auto& alt : clause.alternatives) {
+            if(!index->covers(alt)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+auto SearchManager::lookup_clause(const Clause& clause) const -> std::optional<idset::Set> {
+    auto ret = idset::Set();
+    for(const auto& alt : clause.alternatives) {
+        unwrap(set, index->lookup(alt));
+        ret = idset::unite(ret, set);
+    }
+    return ret;
+}
+
+auto SearchManager::term_fetch_main(const std::string term, const std::shared_ptr<TermFetch> fetch) -> coop::Async<void> {
+    auto ret = co_await coop::run_blocking([arg = quote_term(term)]() { return hitomi::search(arg); });
+    if(ret) {
+        idset::normalize(*ret);
+        cache_result(term_results, term, CachedResult{std::chrono::steady_clock::now(), *ret}, result_ttl, max_term_bytes);
+    }
+    fetch->result   = std::move(ret);
+    fetch->finished = true;
+    term_fetches.erase(term);
+    fetch->event.notify();
+}
+
+auto SearchManager::start_fetch(const std::string& term, const size_t execution) -> std::shared_ptr<TermFetch> {
+    if(const auto p = term_fetches.find(term); p != term_fetches.end()) {
+        p->second->executions.insert(execution);
+        return p->second;
+    }
+    if(const auto p = term_results.find(term); p != term_results.end() && std::chrono::steady_clock::now() - p->second.time < result_ttl) {
+        return nullptr;
+    }
+    const auto fetch = std::make_shared<TermFetch>();
+    fetch->executions.insert(execution);
+    term_fetches.emplace(term, fetch);
+    runner->push_task(term_fetch_main(term, fetch), &fetch->handle);
+    return fetch;
+}
+
+auto SearchManager::release_fetches(const size_t execution) -> void {
+    for(auto p = term_fetches.begin(); p != term_fetches.end();) {
+        const auto fetch = p->second;
+        fetch->executions.erase(execution);
+        if(!fetch->executions.empty()) {
+            p = std::next(p);
+            continue;
+        }
+        // the blocking search runs to the end, but its result is dropped
+        fetch->handle.cancel();
+        fetch->finished = true;
+        fetch->event.notify();
+        p = term_fetches.erase(p);
+    }
+}
+
+auto SearchManager::fetch_term(const std::string& term, const size_t execution, std::shared_ptr<TermFetch> fetch, bool& from_index) -> coop::Async<std::optional<idset::Set>> {
+    if(!fetch) {
+        if(const auto p = term_results.find(term); p != term_results.end()) {
+            co_return p->second.result;
+        }
+        // pruned since, search again
+        fetch = start_fetch(term, execution);
+    }
+    while(!fetch->finished) {
+        co_await fetch->event;
+    }
+    if(!fetch->result) {
+        // probably offline, fall back to galleries we have seen
+        if(!index->covers(term)) {
+            co_return std::nullopt;
+        }
+        from_index = true;
+        co_return index->lookup(term);
+    }
+    co_return fetch->result;
+}
+
+auto SearchManager::fetch_clause(const Clause& clause, const size_t execution, const TermFetches& fetches, bool& from_index) -> coop::Async<std::optional<idset::Set>> {
+    auto ret = idset::Set();
+    for(const auto& alt : clause.alternatives) {
+        const auto p   = fetches.find(alt);
+        const auto set = co_await fetch_term(alt, execution, p != fetches.end() ? p->second : nullptr, from_index);
+        if(!set) {
+            co_return std::nullopt;
+        }
+        ret = ret.empty() ? std::move(*set) : idset::unite(ret, *set);
+    }
+    co_return ret;
+}
+
+auto SearchManager::execute(const Job& job, bool& from_index, const std::function<void(const idset::Set&)> on_progress) -> coop::Async<std::optional<idset::Set>> {
+    const auto clauses_o = parse_args(job.args);
+    if(!clauses_o) {
+        browser->show_message("malformed search, check parentheses");
+        co_return std::nullopt;
+    }
+
+    // a search is the intersection of every clause minus excluded ones
+    // cached clauses go first so that a partial result is ready before waiting for network
+    // excluded ones go last since there is nothing to exclude from before an included one
+    // cache state is taken once, an entry expiring in the middle of sorting would break the order
+    auto       clauses = *clauses_o;
+    const auto local   = job.local && is_indexed(clauses);
+    const auto now     = std::chrono::steady_clock::now();
+    std::stable_sort(clauses.begin(), clauses.end(), [this, now](const Clause& a, const Clause& b) {
+        return std::pair(a.exclude, !is_cached(a, now)) < std::pair(b.exclude, !is_cached(b, now));
+    });
+    auto fetches = TermFetches();
+    if(local) {
+        from_index = true;
+    } else {
+        // every term is searched at once, clauses below wait for them in order
+        for(const auto& clause : clauses) {
+            for(const auto& alt : clause.alternatives) {
+                if(auto fetch = start_fetch(alt, job.id)) {
+                    fetches.emplace(alt, std::move(fetch));
+                }
+            }
+        }
+    }
+
+    auto result = std::optional<idset::Set>();
+    for(const auto& clause : clauses) {
+        if(result && !local && !is_cached(clause, now)) {
+            on_progress(*result);
+        }
+        auto set = local ? lookup_clause(clause) : co_await fetch_clause(clause, job.id, fetches, from_index);
+        if(!set) {
+            co_return std::nullopt;
+        }
+        if(!clause.exclude) {
+            result = result ? idset::intersect(*result, *set) : std::move(*set);
+        } else if(result) {
+            result = idset::difference(*result, *set);
+        } else {
+            // nothing to exclude from
+            co_return std::nullopt;
+        }
+    }
+    co_return result;
+}
+
+auto SearchManager::worker_main(const ConfirmCallback confirm, const ProgressCallback progress, const DoneCallback done) -> coop::Async<void> {
 loop:
     if(jobs.empty()) {
-        co_await worker_event;
+        co_await workers_event;
         goto loop;
     }
     auto job = std::move(jobs.front());
-    jobs.pop();
+    jobs.pop_front();
     if(!confirm(job.id)) {
         goto loop;
     }
 
-    const auto ret = co_await coop::run_blocking([&job]() { return hitomi::search(job.args); });
-    if(ret) {
-        done(job.id, ret.value());
-    } else {
-        done(job.id, {});
+    if(const auto p = results.find(job.key); p != results.end()) {
+        if(std::chrono::steady_clock::now() - p->second.time < result_ttl) {
+            done(job.id, p->second.result);
+            goto loop;
+        }
+        results.erase(p);
+    }
+    if(const auto p = running.find(job.key); p != running.end()) {
+        // same search is in progress, share its result
+        p->second->waiters.push_back(job.id);
+        goto loop;
+    }
+    const auto execution = std::make_shared<Execution>(Execution{job.id, {job.id}});
+    running.emplace(job.key, execution);
+
+    auto       from_index = false;
+    const auto ret        = co_await execute(job, from_index, [&execution, &confirm, &progress](const idset::Set& partial) {
+        for(const auto id : execution->waiters) {
+            if(confirm(id)) {
+                progress(id, partial);
+            }
+        }
+    });
+    // local index grows as browsing, do not keep its results
+    if(ret && !from_index) {
+        cache_result(results, job.key, CachedResult{std::chrono::steady_clock::now(), *ret}, result_ttl, max_result_bytes);
+    }
+    if(ret && from_index && !job.local && !execution->waiters.empty()) {
+        browser->show_message("search failed, showing galleries in local index");
     }
+    for(const auto id : std::exchange(execution->waiters, {})) {
+        if(confirm(id)) {
+            done(id, ret);
+        }
+    }
+    // may be replaced by a new one if every waiter was canceled
+    if(const auto p = running.find(job.key); p != running.end() && p->second == execution) {
+        running.erase(p);
+    }
+    // fetches left by a clause which failed early
+    release_fetches(job.id);
     goto loop;
 }
 
 auto SearchManager::search(std::string args) -> size_t {
     count += 1;
-    jobs.emplace(Job{count, std::move(args)});
-    worker_event.notify();
+    // local searches must not share results with remote ones
+    auto key = (local_first ? "local:" : "") + normalize_args(args);
+    jobs.emplace_back(Job{count, std::move(args), std::move(key), local_first});
+    workers_event.notify();
     return count;
 }
 
-auto SearchManager::run(const ConfirmCallback confirm, const DoneCallback done) -> coop::Async<void> {
-    (co_await coop::reveal_runner())->push_task(worker_main(confirm, done), &worker);
+auto SearchManager::cancel(const size_t job_id) -> void {
+    std::erase_if(jobs, [job_id](const Job& job) { return job.id == job_id; });
+    for(auto p = running.begin(); p != running.end();) {
+        auto& execution = *p->second;
+        if(std::erase(execution.waiters, job_id) == 0 || !execution.waiters.empty()) {
+            p = std::next(p);
+            continue;
+        }
+        // nobody waits for it, a new job with the same key starts afresh
+        release_fetches(execution.id);
+        p = running.erase(p);
+    }
+}
+
+auto SearchManager::run(const ConfirmCallback confirm, const ProgressCallback progress, const DoneCallback done) -> coop::Async<void> {
+    runner = co_await coop::reveal_runner();
+    workers.resize(num_workers);
+    for(auto& worker : workers) {
+        runner->push_task(worker_main(confirm, progress, done), &worker);
+    }
 }
 
 auto SearchManager::shutdown() -> void {
-    worker.cancel();
+    for(auto& worker : workers) {
+        worker.cancel();
+    }
+    for(auto& [_, fetch] : std::exchange(term_fetches, {})) {
+        fetch->handle.cancel();
+    }
 }
 
+SearchManager::SearchManager(lindex::Index& index)
+    : index(&index) {}
+
 SearchManager::~SearchManager() {
     shutdown();
 }
@@ -1,39 +1,123 @@
 #pragma once
+#include <chrono>
+#include <deque>
 #include <functional>
-#include <queue>
+#include <memory>
+#include <unordered_set>
 
 #include <coop/generator.hpp>
-#include <coop/single-event.hpp>
+#include <coop/multi-event.hpp>
+#include <coop/runner.hpp>
+#include <coop/task-handle.hpp>
 
 #include "hitomi/type.hpp"
+#include "id-set.hpp"
+#include "local-index.hpp"
 
 namespace sman {
 struct Job {
     size_t      id;
     std::string args;
+    std::string key;   // normalized args
+    bool        local; // answer from local index if possible
 };
 
 auto confirm(size_t job_id) -> bool;
-auto done(size_t job_id, std::vector<hitomi::GalleryID> result) -> void;
+// partial result while waiting for remaining terms, narrowed by each call
+auto progress(size_t job_id, std::vector<hitomi::GalleryID> result) -> void;
+auto done(size_t job_id, std::optional<std::vector<hitomi::GalleryID>> result) -> void; // nullopt if failed
 
-using ConfirmCallback = std::function<decltype(confirm)>;
-using DoneCallback    = std::function<decltype(done)>;
+using ConfirmCallback  = std::function<decltype(confirm)>;
+using ProgressCallback = std::function<decltype(progress)>;
+using DoneCallback     = std::function<decltype(done)>;
+
+struct CachedResult {
+    std::chrono::steady_clock::time_point time;
+    std::vector<hitomi::GalleryID>        result;
+};
+
+// network search of one term, shared by every job which needs it
+struct TermFetch {
+    coop::TaskHandle           handle;
+    coop::MultiEvent           event; // notified when finished
+    bool                       finished = false;
+    std::optional<idset::Set>  result;     // nullopt if failed
+    std::unordered_set<size_t> executions; // waiting for this, canceled when none is left
+};
+
+// one run of a search, shared by jobs with the same key
+struct Execution {
+    size_t              id;      // of the job which started it
+    std::vector<size_t> waiters; // jobs waiting for the result
+};
+
+using TermFetches = std::unordered_map<std::string, std::shared_ptr<TermFetch>>;
+
+// one argument of a search
+// "term", "-term", "(a|b)" or "-(a|b)"
+struct Clause {
+    std::vector<std::string> alternatives; // sorted
+    bool                     exclude;
+
+    auto operator<=>(const Clause&) const = default;
+};
+
+// splits args into terms, respecting double quotes and parentheses
+// fails if parentheses are unbalanced
+auto split_args(std::string_view args) -> std::optional<std::vector<std::string>>;
+// reverse of split_args for a single term
+auto quote_term(std::string_view term) -> std::string;
+auto parse_args(std::string_view args) -> std::optional<std::vector<Clause>>;
+// makes args which mean the same search identical
+// clauses and alternatives are sorted and deduplicated, quotes are normalized
+auto normalize_args(std::string_view args) -> std::string;
 
 class SearchManager {
   private:
-    size_t count = 0;
+    size_t         count = 0;
+    lindex::Index* index;
+    coop::Runner*  runner = nullptr;
+
+    std::deque<Job>               jobs; // served in order of request, so that every tab gets its turn
+    std::vector<coop::TaskHandle> workers;
+    coop::MultiEvent              workers_event;
 
-    std::queue<Job>   jobs;
-    coop::TaskHandle  worker;
-    coop::SingleEvent worker_event;
+    std::unordered_map<std::string, CachedResult>               results;
+    std::unordered_map<std::string, CachedResult>               term_results; // sorted by idset order
+    TermFetches                                                 term_fetches; // in progress
+    std::unordered_map<std::string, std::shared_ptr<Execution>> running;      // key -> execution, dropped when every waiter is canceled
 
-    auto worker_main(ConfirmCallback confirm, DoneCallback done) -> coop::Async<void>;
+    auto worker_main(ConfirmCallback confirm, ProgressCallback progress, DoneCallback done) -> coop::Async<void>;
+    auto term_fetch_main(std::string term, std::shared_ptr<TermFetch> fetch) -> coop::Async<void>;
+    // starts network search of the term unless it is cached or already running
+    // returns nullptr if cached
+    auto start_fetch(const std::string& term, size_t execution) -> std::shared_ptr<TermFetch>;
+    // cancels fetches which no other execution waits for
+    auto release_fetches(size_t execution) -> void;
+    auto is_cached(const Clause& clause, std::chrono::steady_clock::time_point now) const -> bool;
+    auto is_indexed(const std::vector<Clause>& clauses) const -> bool;
+    auto lookup_clause(const Clause& clause) const -> std::optional<idset::Set>;
+    // fetch is the one started for the execution, nullptr if the term was cached then
+    // from_index is set if the result came from local index, which may be incomplete
+    auto fetch_term(const std::string& term, size_t execution, std::shared_ptr<TermFetch> fetch, bool& from_index) -> coop::Async<std::optional<idset::Set>>;
+    auto fetch_clause(const Clause& clause, size_t execution, const TermFetches& fetches, bool& from_index) -> coop::Async<std::optional<idset::Set>>;
+    auto execute(const Job& job, bool& from_index, std::function<void(const idset::Set&)> on_progress) -> coop::Async<std::optional<idset::Set>>;
 
   public:
+    std::chrono::seconds result_ttl       = std::chrono::minutes(10);
+    size_t               num_workers      = 4;                  // applied on run()
+    size_t               max_term_bytes   = 64uz * 1024 * 1024; // of cached term results
+    size_t               max_result_bytes = 64uz * 1024 * 1024; // of cached search results
+    bool                 local_first      = false;              // skip network if every term is in local index
+
     auto search(std::string args) -> size_t;
-    auto run(ConfirmCallback confirm, DoneCallback done) -> coop::Async<void>;
+    // drops the job if it is not started yet, else discards its result
+    // network searches which no other job waits for are canceled
+    auto cancel(size_t job_id) -> void;
+    auto run(ConfirmCallback confirm, ProgressCallback progress, DoneCallback done) -> coop::Async<void>;
     auto shutdown() -> void;
 
+    SearchManager(lindex::Index& index);
     ~SearchManager();
 };
 } // namespace sman
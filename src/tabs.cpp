@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <format>
+
 #include "tabs.hpp"
 #include "global.hpp"
 
@@ -8,49 +11,141 @@ auto reset_order(std::vector<hitomi::GalleryID>& data) -> void {
 }
 } // namespace
 
+auto to_save_tab_type(const TabType type) -> save::TabType {
+    switch(type) {
+    case TabType::Normal:
+        return save::TabType::Normal;
+    case TabType::Search:
+        return save::TabType::Search;
+    case TabType::Ranked:
+        return save::TabType::Ranked;
+    }
+    return save::TabType::Normal;
+}
+
+auto Tab::get_works() -> WorkList& {
+    if(lazy_works.mapping && !broken) {
+        if(auto ids = save::decode_lazy_ids(lazy_works)) {
+            works.assign(std::move(*ids));
+            lazy_works = {};
+        } else {
+            broken = true;
+            browser->show_message(std::format("failed to load tab {}", title));
+        }
+    }
+    return works;
+}
+
+auto Tab::edit_works() -> WorkList& {
+    auto& ret = get_works();
+    if(broken) {
+        lazy_works = {};
+        broken     = false;
+    }
+    return ret;
+}
+
+auto Tab::get_size() const -> size_t {
+    return lazy_works.mapping && !broken ? lazy_works.count : works.size();
+}
+
 auto Tab::set_index(const size_t new_index) -> void {
     index                 = new_index;
-    browser->current_work = works[index];
+    browser->current_work = get_works()[index];
+    browser->mark_dirty();
 }
 
-auto Tab::set_data(std::vector<hitomi::GalleryID> new_data) -> void {
-    reset_order(new_data);
+auto Tab::set_data(std::vector<hitomi::GalleryID> new_data) -> DataDiff {
+    // already sorted, only the direction differs
+    std::ranges::reverse(new_data);
+    auto& works = edit_works();
     if(works.empty()) {
-        works = std::move(new_data);
-        return;
+        works.assign(new_data);
+        return {new_data.size(), 0};
     }
 
-    auto new_index = int64_t(-1);
-    for(auto i = int64_t(0); i < int64_t(works.size() * 2); i += 1) {
-        const auto search_index = int64_t(index + (i == 0 ? 0 : i % 2 == 1 ? i / 2 + 1
-                                                                           : -i / 2));
-        if(search_index < 0 || search_index >= int64_t(works.size())) {
-            continue;
-        }
-        const auto search_id = hitomi::GalleryID(works[search_index]);
-        const auto pos       = std::lower_bound(new_data.rbegin(), new_data.rend(), search_id);
-        if(pos == new_data.rend() || *pos != search_id) {
-            continue;
+    // single merge pass of both descending lists
+    // remembers the nearest common works before and after the cursor as (old index, new index)
+    const auto old    = works.to_vector();
+    auto       diff   = DataDiff();
+    auto       before = std::optional<std::pair<size_t, size_t>>();
+    auto       after  = std::optional<std::pair<size_t, size_t>>();
+    for(auto i = 0uz, j = 0uz; i < old.size() || j < new_data.size();) {
+        if(j == new_data.size() || (i < old.size() && old[i] > new_data[j])) {
+            diff.removed += 1;
+            i += 1;
+        } else if(i == old.size() || old[i] < new_data[j]) {
+            diff.added += 1;
+            j += 1;
+        } else {
+            if(i <= index) {
+                before = std::pair(i, j);
+            } else if(!after) {
+                after = std::pair(i, j);
+            }
+            i += 1;
+            j += 1;
         }
-        new_index = std::distance(new_data.begin(), pos.base()) - 1;
-        break;
     }
-    works = std::move(new_data);
-    set_index(new_index != -1 ? new_index : 0);
+
+    // prefer the next one on a tie
+    auto new_index = 0uz;
+    if(before && (before->first == index || !after || index - before->first < after->first - index)) {
+        new_index = before->second;
+    } else if(after) {
+        new_index = after->second;
+    }
+    works.assign(new_data);
+    if(works.empty()) {
+        index                 = 0;
+        browser->current_work = -1;
+    } else {
+        set_index(new_index);
+    }
+    return diff;
 }
 
-auto Tab::append_data(const hitomi::GalleryID work) -> void {
-    works.push_back(work);
-    reset_order(works);
+auto Tab::append_data(const hitomi::GalleryID work) -> bool {
+    auto&      works    = edit_works();
+    const auto inserted = works.lower_bound(work);
+    if(inserted != works.size() && works[inserted] == work) {
+        return false;
+    }
+    works.insert(inserted, work);
+    if(works.size() > 1 && inserted <= index) {
+        index += 1;
+    }
+    return true;
+}
+
+auto Tab::append_data(std::vector<hitomi::GalleryID> new_works) -> size_t {
+    reset_order(new_works);
+    auto& works = edit_works();
+    if(works.empty()) {
+        works.assign(new_works);
+        return works.size();
+    }
+
+    const auto current = works[index];
+    const auto before  = works.size();
+    const auto old     = works.to_vector();
+    auto       merged  = std::vector<hitomi::GalleryID>();
+    merged.reserve(old.size() + new_works.size());
+    std::set_union(old.begin(), old.end(), new_works.begin(), new_works.end(), std::back_inserter(merged), std::greater<hitomi::GalleryID>());
+    works.assign(merged);
+    index = works.lower_bound(current);
+    return works.size() - before;
 }
 
 auto Tab::start_search(sman::SearchManager& sman, std::string args) -> bool {
     if(search_id != 0) {
         return false;
     }
-    if(!args.empty()) {
+    if(!args.empty() && args != title) {
+        browser->journal({.op = save::JournalOp::RenameTab, .type = to_save_tab_type(type), .title = title, .new_title = args, .work = 0, .tab = id});
         title = std::move(args);
     }
-    search_id = sman.search(title);
+    refreshing = !get_works().empty();
+    search_id  = sman.search(title);
     return true;
 }
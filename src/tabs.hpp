@@ -3,24 +3,46 @@
 
 #include "hitomi/type.hpp"
 #include "htk/widget.hpp"
+#include "save.hpp"
 #include "search-manager.hpp"
+#include "work-list.hpp"
 
 enum class TabType {
     Normal = 0,
     Search = 1,
+    Ranked = 2, // title search results, best match first instead of descending ids
+};
+
+struct DataDiff {
+    size_t added   = 0;
+    size_t removed = 0;
 };
 
 struct Tab {
     std::shared_ptr<htk::Widget> widget;
 
-    std::vector<hitomi::GalleryID> works;
-    size_t                         index = 0;
-    std::string                    title;
-    size_t                         search_id = 0;
-    TabType                        type;
-
-    auto set_data(std::vector<hitomi::GalleryID> new_data) -> void;
-    auto append_data(hitomi::GalleryID work) -> void;
+    WorkList      works; // use get_works(), may be still in lazy_works
+    save::LazyIDs lazy_works;
+    size_t        index = 0;
+    std::string   title;
+    uint64_t      id         = 0; // identifies the tab in journal records
+    size_t        search_id  = 0;
+    bool          refreshing = false; // searching again with old works shown
+    bool          broken     = false; // lazy_works failed to decode, kept to be saved as it is
+    TabType       type;
+
+    // loads works from the save file on first call
+    auto get_works() -> WorkList&;
+    // get_works() for changing them, broken lazy_works are dropped so that the changes are saved
+    auto edit_works() -> WorkList&;
+    // number of works, without loading them
+    auto get_size() const -> size_t;
+    // new_data is a search result, ascending and unique as idset::Set
+    // the cursor moves to the nearest work which is also in new_data
+    auto set_data(std::vector<hitomi::GalleryID> new_data) -> DataDiff;
+    // inserts keeping descending order, the cursor stays on the same work
+    auto append_data(hitomi::GalleryID work) -> bool;
+    auto append_data(std::vector<hitomi::GalleryID> new_works) -> size_t;
     auto set_index(const size_t index) -> void;
 
     // start search and set tab.search_id and tab.title
@@ -28,6 +50,8 @@ struct Tab {
     auto start_search(sman::SearchManager& sman, std::string args) -> bool;
 };
 
+auto to_save_tab_type(TabType type) -> save::TabType;
+
 struct Tabs {
     std::vector<std::shared_ptr<Tab>> tabs;
     size_t                            index;
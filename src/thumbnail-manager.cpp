@@ -3,74 +3,271 @@
 #include <coop/task-handle.hpp>
 #include <coop/thread.hpp>
 
+#include "byte-io.hpp"
 #include "global.hpp"
 #include "macros/logger.hpp"
+#include "macros/unwrap.hpp"
 #include "thumbnail-manager.hpp"
 
+namespace {
+struct CacheEntry {
+    tman::Metadata         meta;
+    std::vector<std::byte> thumbnail;
+};
+
+// bump this when CacheEntry layout changes
+constexpr auto cache_entry_version = uint32_t(1);
+
+auto store_entry(const dcache::DiskCache& cache, const hitomi::GalleryID id, const CacheEntry& entry) -> bool {
+    const auto& meta   = entry.meta;
+    auto        writer = byteio::Writer();
+    writer.write(cache_entry_version);
+    writer.write_string(meta.display_name);
+    writer.write_string(meta.date);
+    writer.write_string(meta.language);
+    writer.write_string(meta.type);
+    writer.write_strings(meta.artists);
+    writer.write_strings(meta.groups);
+    writer.write_strings(meta.series);
+    writer.write_strings(meta.tags);
+    writer.write(uint64_t(meta.pages));
+    writer.write(uint64_t(entry.thumbnail.size()));
+    writer.write(entry.thumbnail.data(), entry.thumbnail.size());
+    return cache.store(std::to_string(id), writer.release());
+}
+
+auto load_entry(const dcache::DiskCache& cache, const hitomi::GalleryID id) -> std::optional<CacheEntry> {
+    const auto data_o = cache.load(std::to_string(id));
+    if(!data_o) {
+        return std::nullopt;
+    }
+    auto reader = byteio::Reader(*data_o);
+    unwrap(version, reader.read<uint32_t>());
+    ensure(version == cache_entry_version);
+
+    auto  entry = CacheEntry();
+    auto& meta  = entry.meta;
+    unwrap_mut(display_name, reader.read_string());
+    meta.display_name = std::move(display_name);
+    unwrap_mut(date, reader.read_string());
+    meta.date = std::move(date);
+    unwrap_mut(language, reader.read_string());
+    meta.language = std::move(language);
+    unwrap_mut(type, reader.read_string());
+    meta.type = std::move(type);
+    unwrap_mut(artists, reader.read_strings());
+    meta.artists = std::move(artists);
+    unwrap_mut(groups, reader.read_strings());
+    meta.groups = std::move(groups);
+    unwrap_mut(series, reader.read_strings());
+    meta.series = std::move(series);
+    unwrap_mut(tags, reader.read_strings());
+    meta.tags = std::move(tags);
+    unwrap(pages, reader.read<uint64_t>());
+    meta.pages = pages;
+    unwrap(thumbnail_size, reader.read<uint64_t>());
+    ensure(thumbnail_size <= reader.remaining());
+    entry.thumbnail.resize(thumbnail_size);
+    ensure(reader.read(entry.thumbnail.data(), thumbnail_size));
+    return entry;
+}
+} // namespace
+
 namespace tman {
 auto logger = Logger("tman");
 
-auto ThumbnailManager::worker_main(gawl::WaylandWindow* window) -> coop::Async<void> {
+auto Metadata::from_work(const hitomi::Work& work) -> Metadata {
+    return Metadata{
+        .display_name = work.get_display_name(),
+        .date         = work.date,
+        .language     = work.language,
+        .type         = work.type,
+        .artists      = work.artists,
+        .groups       = work.groups,
+        .series       = work.series,
+        .tags         = work.tags,
+        .pages        = work.images.size(),
+    };
+}
+
+auto ThumbnailManager::worker_main(gawl::WaylandWindow* window, Worker& worker) -> coop::Async<void> {
 loop:
+    worker.target = invalid_gallery_id;
+
     // find next load target
-    LOG_DEBUG(logger, "cache={} refcounts={} create={} delete={}", caches.works.size(), caches.refcounts.size(), caches.create_candidates.size(), caches.delete_candidates.size());
+    LOG_DEBUG(logger, "cache={} refcounts={} create={} unused={} bytes={}", caches.works.size(), caches.refcounts.size(), caches.create_candidates.size(), caches.unused.size(), caches.thumbnail_bytes);
     auto& cands = caches.create_candidates;
     if(cands.empty()) {
         co_await workers_event;
         goto loop;
     }
-    const auto target_id = cands[0];
-    cands.erase(cands.begin());
-    if(caches.works.contains(target_id)) {
+    const auto cand = cands.top();
+    cands.pop();
+    if(const auto p = caches.priorities.find(cand.id); p == caches.priorities.end() || p->second != cand.priority) {
+        // outdated or already unreferenced
         goto loop;
+    } else {
+        caches.priorities.erase(p);
     }
-    caches.works.insert({target_id, Work{.state = Work::State::Init, .work = {}, .thumbnail = {}}});
-
-    // download metadata
-    auto       work = hitomi::Work();
-    const auto ret  = co_await coop::run_blocking([&work, target_id]() -> bool { return work.init(target_id); });
+    const auto target_id = cand.id;
+    auto       redecode  = false;
     if(const auto p = caches.works.find(target_id); p != caches.works.end()) {
-        p->second.state = ret ? Work::State::Work : Work::State::Error;
-        p->second.work  = work;
-        browser->refresh_window();
+        // loaded ones are only decoded again when the thumbnail size grew
+        if(!p->second.redecode) {
+            goto loop;
+        }
+        p->second.redecode = false;
+        redecode           = true;
     }
-    if(!ret) {
-        goto loop;
+    worker.target = target_id;
+    worker.cancel = false;
+    if(!redecode) {
+        const auto [p, _] = caches.works.insert({target_id, Work{.state = Work::State::Init, .meta = {}, .thumbnail = {}}});
+        if(!caches.refcounts.contains(target_id)) {
+            mark_unused(target_id, p->second);
+        }
     }
 
-    auto thumbnail = co_await coop::run_blocking([&work]() { return work.get_thumbnail(); });
-    if(!thumbnail) {
-        browser->show_message("failed to download thumbnail");
+    // look up disk cache before touching network
+    auto entry = co_await coop::run_blocking([this, target_id]() { return load_entry(disk_cache, target_id); });
+    if(redecode) {
+        // metadata and the old thumbnail are kept until the new one is uploaded
+        if(!entry) {
+            goto loop;
+        }
+    } else if(entry) {
+        LOG_DEBUG(logger, "disk cache hit {}", target_id);
+        if(const auto p = caches.works.find(target_id); p != caches.works.end()) {
+            p->second.state = Work::State::Work;
+            p->second.meta  = entry->meta;
+            browser->refresh_window();
+        }
+        index->add(target_id, entry->meta);
+    } else {
+        // download metadata
+        const auto work = std::make_shared<hitomi::Work>();
+        const auto ret  = co_await pipeline->fetch([work, target_id]() -> bool { return work->init(target_id); });
+        auto       meta = ret ? Metadata::from_work(*work) : Metadata();
+        if(const auto p = caches.works.find(target_id); p != caches.works.end()) {
+            p->second.state = ret ? Work::State::Work : Work::State::Error;
+            p->second.meta  = meta;
+            browser->refresh_window();
+        }
+        if(!ret) {
+            goto loop;
+        }
+        index->add(target_id, meta);
+        if(worker.cancel) {
+            drop_canceled(worker);
+            goto loop;
+        }
+
+        auto thumbnail = co_await pipeline->fetch([work]() { return work->get_thumbnail(); });
+        // not shared until get_thumbnail finishes with it
+        if(const auto p = caches.works.find(target_id); p != caches.works.end()) {
+            p->second.work = work;
+        }
+        if(!thumbnail) {
+            browser->show_message("failed to download thumbnail");
+            goto loop;
+        }
+
+        entry.emplace(CacheEntry{std::move(meta), std::move(*thumbnail)});
+        const auto stored = co_await coop::run_blocking([this, target_id, &entry]() { return store_entry(disk_cache, target_id, *entry); });
+        if(!stored) {
+            LOG_ERROR(logger, "failed to store disk cache {}", target_id);
+        }
+    }
+    if(worker.cancel) {
+        drop_canceled(worker);
         goto loop;
     }
-    auto pixbuf = co_await coop::run_blocking([&thumbnail]() { return gawl::PixelBuffer::from_blob(*thumbnail); });
+
+    const auto size   = thumbnail_size;
+    auto       pixbuf = co_await pipeline->decode(std::move(entry->thumbnail), size[0], size[1]);
     if(!pixbuf) {
         LOG_ERROR(logger, "failed to load thumbnail");
         goto loop;
     }
-    auto image = co_await coop::run_blocking(
-        [window, &pixbuf]() {
-            auto context = window->fork_context();
-            auto image   = gawl::Graphic(*pixbuf);
-            context.wait();
-            return image;
-        });
+    if(worker.cancel) {
+        drop_canceled(worker);
+        goto loop;
+    }
+    const auto bytes   = pixbuf->get_width() * pixbuf->get_height() * 4;
+    const auto clipped = (size[0] != 0 && pixbuf->get_width() + 1 >= size[0]) || (size[1] != 0 && pixbuf->get_height() + 1 >= size[1]);
+    auto       image   = co_await pipeline->upload(window, std::move(*pixbuf));
 
     // store thumbnail cache
-    if(const auto p = caches.works.find(target_id); p != caches.works.end()) {
-        p->second.thumbnail = std::move(image);
-        p->second.state     = Work::State::Thumbnail;
+    if(const auto p = caches.works.find(target_id); p != caches.works.end() && (!redecode || p->second.state == Work::State::Thumbnail)) {
+        caches.thumbnail_bytes -= p->second.thumbnail_bytes;
+        p->second.thumbnail         = std::move(image);
+        p->second.thumbnail_bytes   = bytes;
+        p->second.thumbnail_clipped = clipped;
+        p->second.state             = Work::State::Thumbnail;
+        caches.thumbnail_bytes += bytes;
+        evict();
         browser->refresh_window();
     }
 
-    // clear cache
-    for(auto work : std::exchange(caches.delete_candidates, {})) {
-        if(!caches.refcounts.contains(work)) {
-            caches.works.erase(work);
+    goto loop;
+}
+
+auto ThumbnailManager::set_cancel(const hitomi::GalleryID id, const bool cancel) -> void {
+    for(auto& worker : workers) {
+        if(worker.target == id) {
+            worker.cancel = cancel;
         }
     }
+}
 
-    goto loop;
+auto ThumbnailManager::drop_canceled(const Worker& worker) -> void {
+    LOG_DEBUG(logger, "canceled {}", worker.target);
+    for(const auto& w : workers) {
+        if(&w != &worker && w.target == worker.target && !w.cancel) {
+            // someone else is still loading it
+            return;
+        }
+    }
+    // half loaded entry must not stay, or it would be never completed
+    if(const auto p = caches.works.find(worker.target); p != caches.works.end()) {
+        if(p->second.state != Work::State::Thumbnail) {
+            erase_work(p);
+        } else if(p->second.thumbnail_clipped) {
+            p->second.redecode = true; // canceled re-decode, retried when referenced again
+        }
+    }
+}
+
+auto ThumbnailManager::mark_unused(const hitomi::GalleryID id, Work& work) -> void {
+    work.unused_pos = caches.unused.insert(caches.unused.end(), id);
+}
+
+auto ThumbnailManager::mark_used(Work& work) -> void {
+    if(work.unused_pos) {
+        caches.unused.erase(*work.unused_pos);
+        work.unused_pos.reset();
+    }
+}
+
+auto ThumbnailManager::erase_work(const std::unordered_map<hitomi::GalleryID, Work>::iterator p) -> void {
+    set_cancel(p->first, true);
+    mark_used(p->second);
+    caches.thumbnail_bytes -= p->second.thumbnail_bytes;
+    caches.works.erase(p);
+}
+
+auto ThumbnailManager::push_candidate(const hitomi::GalleryID id, const Priority priority) -> void {
+    caches.priorities[id] = priority;
+    caches.create_candidates.push(Candidate{priority, id});
+    workers_event.notify();
+}
+
+auto ThumbnailManager::evict() -> void {
+    while(!caches.unused.empty() && (caches.thumbnail_bytes > caches.thumbnail_bytes_limit || caches.unused.size() > caches.unused_works_limit)) {
+        const auto id = caches.unused.front();
+        LOG_DEBUG(logger, "evict {}", id);
+        erase_work(caches.works.find(id));
+    }
 }
 
 auto ThumbnailManager::get_caches() -> const Caches& {
@@ -79,14 +276,15 @@ auto ThumbnailManager::get_caches() -> const Caches& {
 
 auto ThumbnailManager::run(gawl::WaylandWindow* const window) -> coop::Async<void> {
     auto& runner = *co_await coop::reveal_runner();
-    for(auto& handle : workers) {
-        runner.push_task(worker_main(window), &handle);
+    for(auto& worker : workers) {
+        runner.push_task(worker_main(window, worker), &worker.handle);
     }
 }
 
 auto ThumbnailManager::shutdown() -> void {
     for(auto& worker : workers) {
-        worker.cancel();
+        worker.cancel = true;
+        worker.handle.cancel();
     }
 }
 
@@ -98,8 +296,16 @@ auto ThumbnailManager::ref(std::span<const hitomi::GalleryID> works) -> void {
         } else {
             LOG_DEBUG(logger, "ref {} 1(new)", work);
             caches.refcounts.insert({work, 1});
-            caches.create_candidates.push_back(work);
-            workers_event.notify();
+            if(const auto p = caches.works.find(work); p != caches.works.end()) {
+                // still warm
+                mark_used(p->second);
+                set_cancel(work, false);
+                if(p->second.redecode) {
+                    push_candidate(work, {caches.generation, std::numeric_limits<size_t>::max()});
+                }
+                continue;
+            }
+            push_candidate(work, {caches.generation, std::numeric_limits<size_t>::max()});
         }
     }
 }
@@ -114,21 +320,77 @@ auto ThumbnailManager::unref(std::span<const hitomi::GalleryID> works) -> void {
         p->second -= 1;
         LOG_DEBUG(logger, "unref {} {}", work, p->second);
         if(p->second == 0) {
-            caches.delete_candidates.push_back(work);
             caches.refcounts.erase(p);
+            caches.priorities.erase(work);
+            set_cancel(work, true);
+            if(const auto w = caches.works.find(work); w != caches.works.end()) {
+                mark_unused(work, w->second);
+            }
+        }
+    }
+    evict();
+}
+
+auto ThumbnailManager::prioritize(const std::span<const hitomi::GalleryID> works) -> void {
+    caches.generation += 1;
+    for(auto i = 0uz; i < works.size(); i += 1) {
+        if(caches.priorities.contains(works[i])) {
+            push_candidate(works[i], {caches.generation, i});
         }
     }
 }
 
 auto ThumbnailManager::clear(const hitomi::GalleryID work) -> bool {
+    disk_cache.erase(std::to_string(work));
     if(const auto p = caches.works.find(work); p != caches.works.end()) {
-        caches.works.erase(p);
-        caches.create_candidates.insert(caches.create_candidates.begin(), work);
+        erase_work(p);
+        push_candidate(work, {caches.generation, 0});
         return true;
     }
     return false;
 }
 
+auto ThumbnailManager::keep_work(const hitomi::GalleryID id, std::shared_ptr<const hitomi::Work> work) -> void {
+    if(const auto p = caches.works.find(id); p != caches.works.end()) {
+        p->second.work = std::move(work);
+    }
+}
+
+auto ThumbnailManager::get_memory_usage() const -> size_t {
+    return caches.thumbnail_bytes;
+}
+
+auto ThumbnailManager::set_memory_limit(const size_t bytes) -> void {
+    caches.thumbnail_bytes_limit = bytes;
+    evict();
+}
+
+auto ThumbnailManager::set_thumbnail_size(size_t width, size_t height) -> void {
+    // rounded up, so that dragging a split does not decode everything again on every frame
+    width            = (width + thumbnail_size_step - 1) / thumbnail_size_step * thumbnail_size_step;
+    height           = (height + thumbnail_size_step - 1) / thumbnail_size_step * thumbnail_size_step;
+    const auto grown = width > thumbnail_size[0] || height > thumbnail_size[1];
+    thumbnail_size   = {width, height};
+    if(!grown) {
+        return;
+    }
+
+    // clipped thumbnails are too small now, decode them again from the disk cache
+    for(auto& [id, work] : caches.works) {
+        if(work.state != Work::State::Thumbnail || !work.thumbnail_clipped) {
+            continue;
+        }
+        work.redecode = true;
+        if(caches.refcounts.contains(id)) {
+            push_candidate(id, {caches.generation, std::numeric_limits<size_t>::max()});
+        }
+    }
+}
+
+ThumbnailManager::ThumbnailManager(ipipe::Pipeline& pipeline, lindex::Index& index)
+    : pipeline(&pipeline),
+      index(&index) {}
+
 ThumbnailManager::~ThumbnailManager() {
     shutdown();
 }
@@ -1,12 +1,34 @@
 #pragma once
+#include <list>
+#include <queue>
+
 #include <coop/generator.hpp>
 #include <coop/multi-event.hpp>
 
+#include "disk-cache.hpp"
 #include "gawl/graphic.hpp"
 #include "gawl/wayland/window.hpp"
 #include "hitomi/work.hpp"
+#include "image-pipeline.hpp"
+#include "local-index.hpp"
 
 namespace tman {
+// subset of hitomi::Work which widgets need
+// unlike hitomi::Work, this can be stored in the disk cache
+struct Metadata {
+    std::string              display_name;
+    std::string              date;
+    std::string              language;
+    std::string              type;
+    std::vector<std::string> artists;
+    std::vector<std::string> groups;
+    std::vector<std::string> series;
+    std::vector<std::string> tags;
+    size_t                   pages;
+
+    static auto from_work(const hitomi::Work& work) -> Metadata;
+};
+
 struct Work {
     enum class State {
         Init,
@@ -15,27 +37,86 @@ struct Work {
         Error,
     };
     State         state;
-    hitomi::Work  work;
+    Metadata      meta;
     gawl::Graphic thumbnail;
+    size_t        thumbnail_bytes   = 0;
+    bool          thumbnail_clipped = false; // shrunk to the thumbnail size, needs re-decode if the size grows
+    bool          redecode          = false; // clipped and the size grew, old thumbnail is shown until decoded again
+    // initialized in this session, the viewer opens it without network
+    // not available if loaded from the disk cache
+    std::shared_ptr<const hitomi::Work> work;
+
+    // position in Caches::unused, valid only while unreferenced
+    std::optional<std::list<hitomi::GalleryID>::iterator> unused_pos;
+};
+
+struct Priority {
+    uint64_t generation; // bumped by every ThumbnailManager::prioritize call, newer one wins
+    size_t   distance;   // distance from the selected row
+
+    auto operator==(const Priority&) const -> bool = default;
+};
+
+struct Candidate {
+    Priority          priority;
+    hitomi::GalleryID id;
+
+    // std::priority_queue pops the greatest one
+    auto operator<(const Candidate& o) const -> bool {
+        if(priority.generation != o.priority.generation) {
+            return priority.generation < o.priority.generation;
+        }
+        return priority.distance > o.priority.distance;
+    }
 };
 
 struct Caches {
     std::unordered_map<hitomi::GalleryID, int>  refcounts;
     std::unordered_map<hitomi::GalleryID, Work> works;
 
-    std::vector<hitomi::GalleryID> create_candidates;
-    std::vector<hitomi::GalleryID> delete_candidates;
+    // unreferenced works, least recently used first
+    // they are kept until one of the limits below is exceeded
+    std::list<hitomi::GalleryID> unused;
+
+    size_t thumbnail_bytes       = 0;
+    size_t thumbnail_bytes_limit = size_t(256) * 1024 * 1024;
+    size_t unused_works_limit    = 4096;
+
+    // pending load targets and their latest priorities
+    // queue entries which do not match this map are outdated and skipped
+    std::unordered_map<hitomi::GalleryID, Priority> priorities;
+    std::priority_queue<Candidate>                  create_candidates;
+    uint64_t                                        generation = 0;
 };
 
 constexpr auto invalid_gallery_id = hitomi::GalleryID(-1);
 
+struct Worker {
+    coop::TaskHandle  handle;
+    hitomi::GalleryID target = invalid_gallery_id;
+    bool              cancel = false;
+};
+
 class ThumbnailManager {
   private:
-    Caches                          caches;
-    std::array<coop::TaskHandle, 8> workers;
-    coop::MultiEvent                workers_event;
+    constexpr static auto thumbnail_size_step = 64uz;
+
+    Caches                caches;
+    dcache::DiskCache     disk_cache = dcache::DiskCache("thumbnails");
+    ipipe::Pipeline*      pipeline;
+    lindex::Index*        index;
+    std::array<Worker, 8> workers;
+    coop::MultiEvent      workers_event;
+    std::array<size_t, 2> thumbnail_size = {0, 0}; // 0 means unlimited
 
-    auto worker_main(gawl::WaylandWindow* window) -> coop::Async<void>;
+    auto worker_main(gawl::WaylandWindow* window, Worker& worker) -> coop::Async<void>;
+    auto set_cancel(hitomi::GalleryID id, bool cancel) -> void;
+    auto drop_canceled(const Worker& worker) -> void;
+    auto mark_unused(hitomi::GalleryID id, Work& work) -> void;
+    auto mark_used(Work& work) -> void;
+    auto erase_work(std::unordered_map<hitomi::GalleryID, Work>::iterator p) -> void;
+    auto evict() -> void;
+    auto push_candidate(hitomi::GalleryID id, Priority priority) -> void;
 
   public:
     auto get_caches() -> const Caches&;
@@ -43,9 +124,18 @@ class ThumbnailManager {
     auto shutdown() -> void;
     auto ref(std::span<const hitomi::GalleryID> works) -> void;
     auto unref(std::span<const hitomi::GalleryID> works) -> void;
+    // works should be sorted by importance, the first one is loaded first
+    auto prioritize(std::span<const hitomi::GalleryID> works) -> void;
     auto clear(hitomi::GalleryID work) -> bool;
+    // lets the entry of the work reuse one initialized outside, does nothing if not cached
+    auto keep_work(hitomi::GalleryID id, std::shared_ptr<const hitomi::Work> work) -> void;
+    // bytes of thumbnail textures, estimated as width * height * 4
+    auto get_memory_usage() const -> size_t;
+    auto set_memory_limit(size_t bytes) -> void;
+    // thumbnails are decoded at most this size, rounded up to steps
+    auto set_thumbnail_size(size_t width, size_t height) -> void;
 
-    ThumbnailManager() {};
+    ThumbnailManager(ipipe::Pipeline& pipeline, lindex::Index& index);
     ~ThumbnailManager();
 };
 } // namespace tman
@@ -52,10 +52,10 @@ auto GalleryInfoDisplay::refresh(gawl::Screen& screen) -> void {
         return ret.substr(0, ret.size() - 2);
     };
 
-    const auto& gallery  = work.work;
+    const auto& gallery  = work.meta;
     auto        info_str = std::string();
     info_str += gallery.date.substr(0, 10);
-    info_str += std::format("({} pages)", gallery.images.size());
+    info_str += std::format("({} pages)", gallery.pages);
     if(!gallery.language.empty()) {
         info_str += "\nlanguage: " + gallery.language;
     }
@@ -85,6 +85,19 @@ auto GalleryInfoDisplay::refresh(gawl::Screen& screen) -> void {
                                                                                                          });
 }
 
+auto GalleryInfoDisplay::set_region(const gawl::Rectangle& new_region) -> void {
+    Widget::set_region(new_region);
+
+    // largest area refresh() gives to the thumbnail
+    const auto landscape = new_region.width() > new_region.height();
+    const auto width     = landscape ? new_region.width() * thumbnail_limit_rate : new_region.width();
+    const auto height    = landscape ? new_region.height() : new_region.height() * thumbnail_limit_rate;
+    if(width < 1 || height < 1) {
+        return;
+    }
+    tman->set_thumbnail_size(width, height);
+}
+
 GalleryInfoDisplay::GalleryInfoDisplay(htk::Fonts& fonts, tman::ThumbnailManager& tman)
     : fonts(&fonts),
       tman(&tman) {
@@ -14,6 +14,7 @@ class GalleryInfoDisplay : public htk::Widget {
     int    font_size            = 16;
 
     auto refresh(gawl::Screen& screen) -> void override;
+    auto set_region(const gawl::Rectangle& new_region) -> void override;
 
     GalleryInfoDisplay(htk::Fonts& fonts, tman::ThumbnailManager& tman);
 };
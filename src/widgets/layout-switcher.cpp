@@ -32,6 +32,12 @@ auto LayoutSwitcher::on_keycode(const uint32_t key, const htk::Modifiers mods) -
         }
         return false;
     }
+    case KEY_O:
+        browser->toggle_local_search();
+        return true;
+    case KEY_T:
+        browser->begin_input([](std::string buffer) { browser->search_title_in_new_tab(std::move(buffer)); }, "title: ", {}, 0);
+        return true;
     }
 
     if(current->on_keycode(key, mods)) {
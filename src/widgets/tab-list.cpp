@@ -1,5 +1,6 @@
 #include "tab-list.hpp"
 #include "../global.hpp"
+#include "tab.hpp"
 
 auto GalleryTableListCallbacks::get_size() -> size_t {
     return data->tabs.size();
@@ -11,13 +12,16 @@ auto GalleryTableListCallbacks::get_index() -> size_t {
 
 auto GalleryTableListCallbacks::set_index(const size_t new_index) -> void {
     data->index = new_index;
+    browser->mark_dirty();
 
     auto& tab = *data->tabs[data->index];
-    if(!tab.works.empty()) {
-        browser->current_work = tab.works[tab.index];
+    if(const auto& works = tab.get_works(); !works.empty()) {
+        browser->current_work = works[tab.index];
     } else {
         browser->current_work = -1;
     }
+    // background tabs do not load thumbnails
+    std::bit_cast<GalleryTable*>(tab.widget.get())->emit_visible_range_changed();
 }
 
 auto GalleryTableListCallbacks::get_child_widget(const size_t index) -> htk::Widget* {
@@ -44,12 +48,20 @@ auto GalleryTableListCallbacks::get_background_color(const size_t index) -> gawl
 
 auto GalleryTableListCallbacks::begin_rename(const size_t index) -> bool {
     const auto tab = data->tabs[index];
-    browser->begin_input([tab](std::string buffer) { tab->title = std::move(buffer); }, "tabname: ", tab->title, tab->title.size());
+    const auto handler = [tab](std::string buffer) {
+        browser->journal({.op = save::JournalOp::RenameTab, .type = to_save_tab_type(tab->type), .title = tab->title, .new_title = buffer, .work = 0, .tab = tab->id});
+        tab->title = std::move(buffer);
+    };
+    browser->begin_input(handler, "tabname: ", tab->title, tab->title.size());
     return true;
 }
 
 auto GalleryTableListCallbacks::erase(const size_t index) -> bool {
     auto& tabs = data->tabs;
+    if(const auto search_id = tabs[index]->search_id; search_id != 0) {
+        sman->cancel(search_id);
+    }
+    browser->journal({.op = save::JournalOp::EraseTab, .type = to_save_tab_type(tabs[index]->type), .title = tabs[index]->title, .new_title = {}, .work = 0, .tab = tabs[index]->id});
     tabs.erase(tabs.begin() + index);
     return true;
 }
@@ -57,4 +69,5 @@ auto GalleryTableListCallbacks::erase(const size_t index) -> bool {
 auto GalleryTableListCallbacks::swap(const size_t first, const size_t second) -> void {
     auto& tabs = data->tabs;
     std::swap(tabs[first], tabs[second]);
+    browser->mark_dirty();
 }
@@ -2,7 +2,8 @@
 #include "../tabs.hpp"
 
 struct GalleryTableListCallbacks : htk::tablist::Callbacks {
-    Tabs* data;
+    Tabs*                data;
+    sman::SearchManager* sman;
 
     auto get_size() -> size_t override;
     auto get_index() -> size_t override;
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <linux/input.h>
+#include <sstream>
 
 #include "../global.hpp"
 #include "tab.hpp"
@@ -9,8 +10,8 @@ auto GalleryTable::on_keycode(const uint32_t key, const htk::Modifiers mods) ->
     return cb->on_keycode(key, mods) || Table::on_keycode(key, mods);
 }
 
-auto GalleryTableCallbacks::get_current_work(const tman::Caches& caches) -> const hitomi::Work* {
-    if(const auto p = caches.works.find(data->works[data->index]); p == caches.works.end()) {
+auto GalleryTableCallbacks::get_current_work(const tman::Caches& caches) -> const tman::Metadata* {
+    if(const auto p = caches.works.find(data->get_works()[data->index]); p == caches.works.end()) {
         return nullptr;
     } else {
         switch(p->second.state) {
@@ -19,14 +20,32 @@ auto GalleryTableCallbacks::get_current_work(const tman::Caches& caches) -> cons
             return nullptr;
         case tman::Work::State::Work:
         case tman::Work::State::Thumbnail:
-            return &p->second.work;
+            return &p->second.meta;
         }
     }
 }
 
 auto GalleryTableCallbacks::on_keycode(const uint32_t key, const htk::Modifiers mods) -> bool {
+    if(key == KEY_I && data->type == TabType::Normal) {
+        // import ids separated by spaces or newlines
+        const auto handler = [this](const std::string buffer) {
+            auto ids    = std::vector<hitomi::GalleryID>();
+            auto stream = std::istringstream(buffer);
+            for(auto id = hitomi::GalleryID(); stream >> id;) {
+                ids.push_back(id);
+            }
+            for(const auto id : ids) {
+                browser->journal({.op = save::JournalOp::Bookmark, .type = save::TabType::Normal, .title = data->title, .new_title = {}, .work = id, .tab = data->id});
+            }
+            const auto added = data->append_data(std::move(ids));
+            browser->show_message(std::format("imported {} works", added));
+            std::bit_cast<GalleryTable*>(data->widget.get())->emit_visible_range_changed();
+        };
+        browser->begin_input(handler, "import: ", "", 0);
+        return true;
+    }
     {
-        if(data->works.empty()) {
+        if(data->get_works().empty()) {
             return false;
         }
 
@@ -57,7 +76,7 @@ auto GalleryTableCallbacks::on_keycode(const uint32_t key, const htk::Modifiers
             return true;
         } break;
         case KEY_ENTER: {
-            const auto id     = data->works[data->index];
+            const auto id     = data->get_works()[data->index];
             auto       init   = browser->last_bookmark ? *browser->last_bookmark : "";
             auto       cursor = init.size();
 
@@ -67,30 +86,31 @@ auto GalleryTableCallbacks::on_keycode(const uint32_t key, const htk::Modifiers
         case KEY_P: {
             const auto handler = [this](std::string buffer) {
                 const auto rel       = buffer[0] == '+' || buffer[0] == '-';
-                auto       new_index = rel ? data->index : 0;
+                auto       new_index = rel ? int64_t(data->index) : int64_t(0);
                 try {
                     new_index += (std::stoi(buffer) - 1);
                 } catch(const std::invalid_argument&) {
                     return;
                 }
-                if(new_index < 0 || size_t(new_index) >= data->works.size()) {
+                if(new_index < 0 || size_t(new_index) >= data->get_works().size()) {
                     browser->show_message("invalid position");
                     return;
                 }
                 set_index(new_index);
+                // jumping does not go through table actions, so tell the table here
+                std::bit_cast<GalleryTable*>(data->widget.get())->emit_visible_range_changed();
             };
             browser->begin_input(handler, "jump: ", "", 0);
             return true;
         } break;
         case KEY_C: {
-            if(tman->clear(data->works[data->index])) {
+            if(tman->clear(data->get_works()[data->index])) {
                 browser->refresh_window();
             }
         } break;
         case KEY_BACKSLASH: {
-            const auto work = get_current_work(caches);
-            if(work != nullptr) {
-                browser->open_viewer(*work);
+            if(get_current_work(caches) != nullptr) {
+                browser->open_viewer(data->get_works()[data->index]);
             }
             return false;
         } break;
@@ -100,7 +120,8 @@ auto GalleryTableCallbacks::on_keycode(const uint32_t key, const htk::Modifiers
 }
 
 auto GalleryTableCallbacks::get_size() -> size_t {
-    return data->works.size();
+    // called on resize for every tab, which must not load unvisited ones
+    return data->get_size();
 }
 
 auto GalleryTableCallbacks::get_index() -> size_t {
@@ -113,8 +134,9 @@ auto GalleryTableCallbacks::set_index(const size_t new_index) -> void {
 
 auto GalleryTableCallbacks::get_label(const size_t index) -> std::string {
     auto&      caches = tman->get_caches();
-    const auto id_str = std::to_string(data->works[index]);
-    if(const auto p = caches.works.find(data->works[index]); p == caches.works.end()) {
+    const auto id     = data->get_works()[index];
+    const auto id_str = std::to_string(id);
+    if(const auto p = caches.works.find(id); p == caches.works.end()) {
         return id_str;
     } else {
         auto& work = p->second;
@@ -123,7 +145,7 @@ auto GalleryTableCallbacks::get_label(const size_t index) -> std::string {
             return id_str + "...";
         case tman::Work::State::Work:
         case tman::Work::State::Thumbnail:
-            return work.work.get_display_name() + "(" + id_str + ")";
+            return work.meta.display_name + "(" + id_str + ")";
         case tman::Work::State::Error:
             return id_str + "(error)";
         }
@@ -131,25 +153,85 @@ auto GalleryTableCallbacks::get_label(const size_t index) -> std::string {
 }
 
 auto GalleryTableCallbacks::erase(const size_t index) -> bool {
-    data->works.erase(data->works.begin() + index);
+    auto& works = data->edit_works();
+    browser->journal({.op = save::JournalOp::EraseWork, .type = to_save_tab_type(data->type), .title = data->title, .new_title = {}, .work = works[index], .tab = data->id});
+    works.erase(index);
     return true;
 }
 
-auto GalleryTableCallbacks::on_visible_range_change(const size_t begin, const size_t end) -> void {
-    auto new_visibles = std::vector<hitomi::GalleryID>();
-    for(auto i = begin; i <= end; i += 1) {
-        new_visibles.push_back(data->works[i]);
-    }
-
+auto GalleryTableCallbacks::update_refs(std::vector<hitomi::GalleryID>& current, std::vector<hitomi::GalleryID> next) -> std::vector<hitomi::GalleryID> {
+    // tabs are usually sorted in descending order, but ranked ones are not
+    std::sort(next.begin(), next.end(), std::greater<hitomi::GalleryID>());
     auto gone = std::vector<hitomi::GalleryID>();
-    std::set_difference(visibles.rbegin(), visibles.rend(), new_visibles.rbegin(), new_visibles.rend(), std::back_inserter(gone));
+    std::set_difference(current.rbegin(), current.rend(), next.rbegin(), next.rend(), std::back_inserter(gone));
     auto came = std::vector<hitomi::GalleryID>();
-    std::set_difference(new_visibles.rbegin(), new_visibles.rend(), visibles.rbegin(), visibles.rend(), std::back_inserter(came));
+    std::set_difference(next.rbegin(), next.rend(), current.rbegin(), current.rend(), std::back_inserter(came));
 
-    visibles = std::move(new_visibles);
+    current = std::move(next);
 
     tman->ref(came);
-    tman->unref(gone);
+    return gone;
+}
+
+auto GalleryTableCallbacks::update_velocity(const size_t index, const size_t rows) -> void {
+    const auto now  = std::chrono::steady_clock::now();
+    const auto dt   = std::chrono::duration<double>(now - prev_time).count();
+    const auto diff = double(index) - double(prev_index);
+    if(dt > 1.0 || std::abs(diff) > double(rows)) {
+        // idle or jumped, not scrolling
+        velocity = 0;
+    } else if(dt > 0) {
+        velocity = (velocity + diff / dt) / 2;
+    }
+    prev_index = index;
+    prev_time  = now;
+}
+
+auto GalleryTableCallbacks::on_visible_range_change(const size_t begin, const size_t end) -> void {
+    // tabs in background are not shown, the range is emitted again when switched to
+    if(!browser->is_current_tab(*data)) {
+        return;
+    }
+    const auto& works = data->get_works();
+    const auto  index = data->index;
+    const auto  size  = works.size();
+    update_velocity(index, end - begin + 1);
+
+    // extend the range to the scrolling direction
+    const auto extra  = std::min(size_t(std::abs(velocity) * prefetch_seconds), prefetch_rows_max);
+    const auto ahead  = prefetch_rows + (velocity > 0 ? extra : 0);
+    const auto behind = prefetch_rows + (velocity < 0 ? extra : 0);
+    const auto pbegin = begin < behind ? 0 : begin - behind;
+    const auto pend   = std::min(end + ahead, size - 1);
+
+    auto new_visibles   = std::vector<hitomi::GalleryID>();
+    auto new_prefetches = std::vector<hitomi::GalleryID>();
+    for(auto i = pbegin; i <= pend; i += 1) {
+        (i >= begin && i <= end ? new_visibles : new_prefetches).push_back(works[i]);
+    }
+    // rows moving between the two sets must not drop to zero refs in between, or their loads would be canceled
+    const auto gone_visibles   = update_refs(visibles, std::move(new_visibles));
+    const auto gone_prefetches = update_refs(prefetches, std::move(new_prefetches));
+    tman->unref(gone_visibles);
+    tman->unref(gone_prefetches);
+
+    // load from the selected row outwards, visible rows first
+    auto ordered          = std::vector<hitomi::GalleryID>();
+    auto ordered_prefetch = std::vector<hitomi::GalleryID>();
+    ordered.reserve(pend - pbegin + 1);
+    const auto push = [&](const size_t i) {
+        (i >= begin && i <= end ? ordered : ordered_prefetch).push_back(works[i]);
+    };
+    for(auto d = 0uz; index >= pbegin + d || index + d <= pend; d += 1) {
+        if(index + d <= pend) {
+            push(index + d);
+        }
+        if(d != 0 && index >= pbegin + d) {
+            push(index - d);
+        }
+    }
+    ordered.insert(ordered.end(), ordered_prefetch.begin(), ordered_prefetch.end());
+    tman->prioritize(ordered);
 }
 
 GalleryTableCallbacks::GalleryTableCallbacks(std::shared_ptr<Tab> data, tman::ThumbnailManager& tman)
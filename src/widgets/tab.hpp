@@ -1,4 +1,5 @@
 #pragma once
+#include <chrono>
 #include <vector>
 
 #include "../htk/table.hpp"
@@ -15,11 +16,26 @@ class GalleryTableCallbacks : public htk::table::Callbacks {
   protected:
     std::shared_ptr<Tab>           data;
     std::vector<hitomi::GalleryID> visibles;
+    std::vector<hitomi::GalleryID> prefetches; // referenced but not on screen
     tman::ThumbnailManager*        tman;
 
-    auto get_current_work(const tman::Caches& caches) -> const hitomi::Work*;
+    // rows per second, positive if scrolling down
+    double                                velocity   = 0;
+    size_t                                prev_index = 0;
+    std::chrono::steady_clock::time_point prev_time;
+
+    auto get_current_work(const tman::Caches& caches) -> const tman::Metadata*;
+    // refs new ones and returns old ones, which the caller should unref
+    auto update_refs(std::vector<hitomi::GalleryID>& current, std::vector<hitomi::GalleryID> next) -> std::vector<hitomi::GalleryID>;
+    auto update_velocity(size_t index, size_t rows) -> void;
 
   public:
+    // rows prefetched beyond the visible range in each direction
+    size_t prefetch_rows     = 8;
+    // plus rows reached within this many seconds at the current velocity
+    double prefetch_seconds  = 1.0;
+    size_t prefetch_rows_max = 64;
+
     auto get_size() -> size_t override;
     auto set_index(size_t new_index) -> void override;
     auto get_index() -> size_t override;
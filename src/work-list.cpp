@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <bit>
+
+#include "work-list.hpp"
+
+auto WorkList::rebuild_tree() -> void {
+    tree.assign(chunks.size() + 1, 0);
+    for(auto i = 1uz; i < tree.size(); i += 1) {
+        tree[i] += chunks[i - 1].size();
+        if(const auto parent = i + (i & -i); parent < tree.size()) {
+            tree[parent] += tree[i];
+        }
+    }
+}
+
+auto WorkList::add_to_tree(const size_t chunk, const int64_t diff) -> void {
+    for(auto i = chunk + 1; i < tree.size(); i += i & -i) {
+        tree[i] += diff;
+    }
+    total += diff;
+}
+
+auto WorkList::get_chunk_begin(const size_t chunk) const -> size_t {
+    auto sum = 0uz;
+    for(auto i = chunk; i > 0; i -= i & -i) {
+        sum += tree[i];
+    }
+    return sum;
+}
+
+auto WorkList::locate(const size_t index) const -> std::pair<size_t, size_t> {
+    if(index == total) {
+        return chunks.empty() ? std::pair(0uz, 0uz) : std::pair(chunks.size() - 1, chunks.back().size());
+    }
+    // descend the tree to the last chunk whose begin is not greater than index
+    auto pos  = 0uz;
+    auto rest = index;
+    for(auto step = std::bit_floor(chunks.size()); step > 0; step >>= 1) {
+        if(pos + step < tree.size() && tree[pos + step] <= rest) {
+            pos += step;
+            rest -= tree[pos];
+        }
+    }
+    return {pos, rest};
+}
+
+auto WorkList::size() const -> size_t {
+    return total;
+}
+
+auto WorkList::empty() const -> bool {
+    return total == 0;
+}
+
+auto WorkList::operator[](const size_t index) const -> hitomi::GalleryID {
+    const auto [chunk, offset] = locate(index);
+    return chunks[chunk][offset];
+}
+
+auto WorkList::insert(const size_t index, const hitomi::GalleryID id) -> void {
+    if(chunks.empty()) {
+        chunks.push_back({id});
+        total = 1;
+        rebuild_tree();
+        return;
+    }
+    const auto [chunk, offset] = locate(index);
+    auto& target               = chunks[chunk];
+    target.insert(target.begin() + offset, id);
+    if(target.size() < chunk_size * 2) {
+        add_to_tree(chunk, 1);
+        return;
+    }
+    // split
+    auto latter = std::vector<hitomi::GalleryID>(target.begin() + chunk_size, target.end());
+    target.resize(chunk_size);
+    chunks.insert(chunks.begin() + chunk + 1, std::move(latter));
+    total += 1;
+    rebuild_tree();
+}
+
+auto WorkList::erase(const size_t index) -> void {
+    const auto [chunk, offset] = locate(index);
+    auto& target               = chunks[chunk];
+    target.erase(target.begin() + offset);
+    if(target.size() >= chunk_size / 2 || (chunks.size() == 1 && !target.empty())) {
+        add_to_tree(chunk, -1);
+        return;
+    }
+    total -= 1;
+    if(chunks.size() == 1) {
+        chunks.clear();
+        rebuild_tree();
+        return;
+    }
+    // merge with a neighbour, so that erasing many does not leave tiny chunks behind
+    const auto first  = chunk + 1 < chunks.size() ? chunk : chunk - 1;
+    auto&      merged = chunks[first];
+    auto&      next   = chunks[first + 1];
+    merged.insert(merged.end(), next.begin(), next.end());
+    chunks.erase(chunks.begin() + first + 1);
+    if(merged.size() >= chunk_size * 2) {
+        // too large for one, split evenly
+        const auto half   = merged.size() / 2;
+        auto       latter = std::vector<hitomi::GalleryID>(merged.begin() + half, merged.end());
+        merged.resize(half);
+        chunks.insert(chunks.begin() + first + 1, std::move(latter));
+    }
+    rebuild_tree();
+}
+
+auto WorkList::lower_bound(const hitomi::GalleryID id) const -> size_t {
+    // first chunk whose last id is not greater than id
+    const auto chunk = std::partition_point(chunks.begin(), chunks.end(), [id](const auto& c) { return c.back() > id; });
+    if(chunk == chunks.end()) {
+        return total;
+    }
+    const auto pos = std::lower_bound(chunk->begin(), chunk->end(), id, std::greater<hitomi::GalleryID>());
+    return get_chunk_begin(chunk - chunks.begin()) + (pos - chunk->begin());
+}
+
+auto WorkList::find(const hitomi::GalleryID id) const -> std::optional<size_t> {
+    const auto index = lower_bound(id);
+    if(index == total || (*this)[index] != id) {
+        return std::nullopt;
+    }
+    return index;
+}
+
+auto WorkList::assign(const std::span<const hitomi::GalleryID> ids) -> void {
+    chunks.clear();
+    for(auto i = 0uz; i < ids.size(); i += chunk_size) {
+        const auto chunk = ids.subspan(i, std::min(chunk_size, ids.size() - i));
+        chunks.emplace_back(chunk.begin(), chunk.end());
+    }
+    total = ids.size();
+    rebuild_tree();
+}
+
+auto WorkList::to_vector() const -> std::vector<hitomi::GalleryID> {
+    auto ret = std::vector<hitomi::GalleryID>();
+    ret.reserve(total);
+    for(const auto& chunk : chunks) {
+        ret.insert(ret.end(), chunk.begin(), chunk.end());
+    }
+    return ret;
+}
+
+WorkList::WorkList(const std::span<const hitomi::GalleryID> ids) {
+    assign(ids);
+}
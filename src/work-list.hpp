@@ -0,0 +1,41 @@
+#pragma once
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "hitomi/type.hpp"
+
+// sequence of gallery ids split into chunks, for tabs with hundreds of thousands of works
+// chunks are split when they reach twice chunk_size and merged with a neighbour under half of it
+// insert and erase move at most two chunks, index lookups go through a fenwick tree of chunk sizes
+class WorkList {
+  private:
+    std::vector<std::vector<hitomi::GalleryID>> chunks;
+    std::vector<size_t>                         tree; // fenwick tree of chunk sizes, 1-origin
+    size_t                                      total = 0;
+
+    auto rebuild_tree() -> void;
+    auto add_to_tree(size_t chunk, int64_t diff) -> void;
+    // number of ids before the chunk
+    auto get_chunk_begin(size_t chunk) const -> size_t;
+    // chunk and offset in it, index may be equal to size
+    auto locate(size_t index) const -> std::pair<size_t, size_t>;
+
+  public:
+    static constexpr auto chunk_size = 512uz;
+
+    auto size() const -> size_t;
+    auto empty() const -> bool;
+    auto operator[](size_t index) const -> hitomi::GalleryID;
+    auto insert(size_t index, hitomi::GalleryID id) -> void;
+    auto erase(size_t index) -> void;
+    // the list must be in descending order
+    // index of the first id not greater than the given one
+    auto lower_bound(hitomi::GalleryID id) const -> size_t;
+    auto find(hitomi::GalleryID id) const -> std::optional<size_t>;
+    auto assign(std::span<const hitomi::GalleryID> ids) -> void;
+    auto to_vector() const -> std::vector<hitomi::GalleryID>;
+
+    WorkList() = default;
+    WorkList(std::span<const hitomi::GalleryID> ids);
+};
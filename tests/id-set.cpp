@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+#include "../src/id-set.hpp"
+
+namespace {
+auto rng = std::mt19937(1);
+
+auto make_set(const size_t size, const uint32_t range) -> idset::Set {
+    auto set = idset::Set(size);
+    for(auto& id : set) {
+        id = hitomi::GalleryID(rng() % range);
+    }
+    idset::normalize(set);
+    return set;
+}
+
+auto test(const idset::Set& a, const idset::Set& b) -> bool {
+    auto intersection = idset::Set();
+    auto difference   = idset::Set();
+    auto union_       = idset::Set();
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(intersection));
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(difference));
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(union_));
+    if(idset::intersect(a, b) != intersection || idset::intersect(b, a) != intersection) {
+        std::fprintf(stderr, "intersect failed: %zu x %zu\n", a.size(), b.size());
+        return false;
+    }
+    if(idset::difference(a, b) != difference) {
+        std::fprintf(stderr, "difference failed: %zu x %zu\n", a.size(), b.size());
+        return false;
+    }
+    if(idset::unite(a, b) != union_) {
+        std::fprintf(stderr, "unite failed: %zu x %zu\n", a.size(), b.size());
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+// compares set operations against the standard algorithms
+// sizes cover the block kernel, its scalar tail and the galloping path
+auto main() -> int {
+    if(!test({}, {}) || !test({1, 2, 3}, {}) || !test({}, {1, 2, 3})) {
+        return 1;
+    }
+    for(auto i = 0; i < 2000; i += 1) {
+        const auto a = make_set(rng() % 300, rng() % 1000 + 1);
+        const auto b = make_set(rng() % 300, rng() % 1000 + 1);
+        if(!test(a, b)) {
+            return 1;
+        }
+    }
+    for(auto i = 0; i < 100; i += 1) {
+        const auto a = make_set(rng() % 16 + 1, 100000);
+        const auto b = make_set(rng() % 20000 + 1000, 100000);
+        if(!test(a, b) || !test(b, a)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <filesystem>
+
+#include <unistd.h>
+
+#include "../src/save.hpp"
+
+namespace {
+auto journal_path() -> std::string {
+    return std::string(std::getenv("HOME")) + "/.cache/hitomi-browser.journal";
+}
+
+auto get_ids(const save::TabData& tab) -> std::vector<hitomi::GalleryID> {
+    if(!tab.lazy_data.mapping) {
+        return tab.data;
+    }
+    return save::decode_lazy_ids(tab.lazy_data).value_or(std::vector<hitomi::GalleryID>());
+}
+
+auto check(const bool cond, const char* const message) -> bool {
+    if(!cond) {
+        std::fprintf(stderr, "%s\n", message);
+    }
+    return cond;
+}
+} // namespace
+
+// save and journal round trip, records after a torn one must survive the next load
+auto main() -> int {
+    std::filesystem::create_directories(std::string(std::getenv("HOME")) + "/.cache");
+
+    auto data = save::SaveData();
+    data.tabs.push_back({.title = "a", .data = {5, 3}, .lazy_data = {}, .index = 0, .type = save::TabType::Normal, .id = 1});
+    data.tabs.push_back({.title = "a", .data = {7}, .lazy_data = {}, .index = 0, .type = save::TabType::Normal, .id = 2});
+    data.sequence = 1;
+    if(!check(save::save_savedata(data) && save::clear_journal(), "failed to save")) {
+        return 1;
+    }
+
+    // the first one is already in the save
+    const auto records = std::vector<save::JournalRecord>{
+        {save::JournalOp::Bookmark, save::TabType::Normal, "a", "", 1, 1, 1},
+        {save::JournalOp::RenameTab, save::TabType::Normal, "a", "b", 0, 2, 2},
+        {save::JournalOp::Bookmark, save::TabType::Normal, "b", "", 9, 3, 2},
+        {save::JournalOp::EraseWork, save::TabType::Normal, "a", "", 5, 4, 1},
+    };
+    if(!check(save::append_journal(records), "failed to append")) {
+        return 1;
+    }
+    const auto loaded = save::load_journal();
+    if(!check(loaded.size() == records.size(), "records lost")) {
+        return 1;
+    }
+    auto restored = save::load_savedata();
+    if(!check(restored.has_value(), "failed to load save")) {
+        return 1;
+    }
+    save::apply_journal(*restored, loaded);
+    const auto& tabs = restored->tabs;
+    if(!check(tabs.size() == 2 && tabs[0].title == "a" && tabs[1].title == "b", "wrong tabs") ||
+       !check(get_ids(tabs[0]) == std::vector<hitomi::GalleryID>{3}, "wrong ids in tab a") ||
+       !check(get_ids(tabs[1]) == std::vector<hitomi::GalleryID>{9, 7}, "wrong ids in tab b") ||
+       !check(restored->sequence == 4, "wrong sequence")) {
+        return 1;
+    }
+
+    // tear the last record as a crash while appending would
+    const auto size = std::filesystem::file_size(journal_path());
+    if(!check(truncate(journal_path().data(), off_t(size - 3)) == 0, "failed to truncate")) {
+        return 1;
+    }
+    if(!check(save::load_journal().size() == records.size() - 1, "torn record not dropped")) {
+        return 1;
+    }
+    const auto more = std::vector<save::JournalRecord>{{save::JournalOp::Bookmark, save::TabType::Normal, "b", "", 11, 5, 2}};
+    if(!check(save::append_journal(more), "failed to append")) {
+        return 1;
+    }
+    const auto after = save::load_journal();
+    if(!check(after.size() == records.size() && after.back().work == 11, "record after torn tail lost")) {
+        return 1;
+    }
+    return 0;
+}
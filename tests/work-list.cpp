@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+#include "../src/work-list.hpp"
+
+// random inserts and erases against a plain vector, enough to split and merge chunks many times
+auto main() -> int {
+    auto rng = std::mt19937(1);
+    for(auto round = 0; round < 10; round += 1) {
+        auto expected = std::vector<hitomi::GalleryID>(rng() % 5000);
+        for(auto& id : expected) {
+            id = hitomi::GalleryID(rng());
+        }
+        std::sort(expected.begin(), expected.end(), std::greater<hitomi::GalleryID>());
+        expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+        auto list = WorkList(expected);
+
+        for(auto op = 0; op < 10000; op += 1) {
+            // erase more than insert so that lists shrink to nothing in some rounds
+            if(!expected.empty() && rng() % 5 < 3) {
+                const auto index = rng() % expected.size();
+                expected.erase(expected.begin() + index);
+                list.erase(index);
+            } else {
+                const auto id    = hitomi::GalleryID(rng());
+                const auto index = list.lower_bound(id);
+                if(list.find(id)) {
+                    continue;
+                }
+                expected.insert(expected.begin() + index, id);
+                list.insert(index, id);
+            }
+            if(list.size() != expected.size()) {
+                std::fprintf(stderr, "size mismatch\n");
+                return 1;
+            }
+            if(op % 100 != 0) {
+                continue;
+            }
+            if(list.to_vector() != expected) {
+                std::fprintf(stderr, "content mismatch\n");
+                return 1;
+            }
+            for(auto i = 0uz; i < expected.size(); i += 13) {
+                if(list[i] != expected[i] || list.find(expected[i]) != i) {
+                    std::fprintf(stderr, "lookup mismatch at %zu\n", i);
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}